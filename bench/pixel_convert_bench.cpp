@@ -0,0 +1,61 @@
+// Throughput of the 16 to 8-bit conversion kernels on a 24 MP frame.
+// Build with -DSR_BUILD_BENCHMARKS=ON and run pixel_convert_bench.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "pixel_convert.hpp"
+
+const int WIDTH = 6000;
+const int HEIGHT = 4000;
+const int PRECISION = 12;
+const int ITERATIONS = 20;
+
+// Best of ITERATIONS runs, in source megapixels per second
+template <typename F> static double measure(F &&run) {
+  double best_seconds = 1e9;
+  for (int i = 0; i < ITERATIONS; i++) {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    if (elapsed.count() < best_seconds) {
+      best_seconds = elapsed.count();
+    }
+  }
+  return double(WIDTH) * HEIGHT / 1e6 / best_seconds;
+}
+
+int main() {
+  size_t pixel_count = size_t(WIDTH) * HEIGHT;
+  std::vector<uint16_t> src(pixel_count * 4);
+  std::vector<uint8_t> dst(pixel_count * 4);
+
+  std::mt19937 rng(42);
+  for (uint16_t &sample : src) {
+    sample = static_cast<uint16_t>(rng() & ((1u << PRECISION) - 1));
+  }
+
+  printf("%dx%d, %d-bit, best of %d\n", WIDTH, HEIGHT, PRECISION, ITERATIONS);
+  printf("%-8s %12s %12s\n", "kernel", "convert", "convert/2");
+  for (int i = 0; i < PixelConvert::KERNEL_COUNT; i++) {
+    PixelConvert::Kernel kernel = static_cast<PixelConvert::Kernel>(i);
+    if (!PixelConvert::kernel_supported(kernel)) {
+      continue;
+    }
+    double convert = measure([&] {
+      PixelConvert::rgba16_to_rgba8(src.data(), dst.data(), pixel_count,
+                                    PRECISION, kernel);
+    });
+    double convert_half = measure([&] {
+      PixelConvert::rgba16_to_rgba8_half(src.data(), WIDTH, HEIGHT, dst.data(),
+                                         PRECISION, kernel);
+    });
+    printf("%-8s %7.0f MP/s %7.0f MP/s\n", PixelConvert::kernel_name(kernel),
+           convert, convert_half);
+  }
+  return 0;
+}
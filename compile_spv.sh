@@ -7,10 +7,19 @@ glslc --target-env=vulkan1.2 -O -g -fshader-stage=frag -o src/shaders/color_rect
 
 glslc --target-env=vulkan1.2 -O -g -fshader-stage=frag -o src/shaders/text.frag.spv src/shaders/text.frag
 
+glslc --target-env=vulkan1.2 -O -g -fshader-stage=frag -o src/shaders/text_sdf.frag.spv src/shaders/text_sdf.frag
+
 glslc --target-env=vulkan1.2 -O -g -fshader-stage=frag -o src/shaders/arc.frag.spv src/shaders/arc.frag
 
 glslc --target-env=vulkan1.2 -O -g -fshader-stage=frag -o src/shaders/texture_rect.frag.spv src/shaders/texture_rect.frag
 
 glslc --target-env=vulkan1.2 -O -g -fshader-stage=vert -o src/shaders/basic.vert.spv src/shaders/basic.vert
 
-glslc --target-env=vulkan1.2 -O -g -fshader-stage=vert -o src/shaders/text.vert.spv src/shaders/text.vert
+glslc --target-env=vulkan1.2 -O -g -fshader-stage=vert -o src/shaders/quad.vert.spv src/shaders/quad.vert
+
+# Catch anything a driver would reject before it gets committed
+if command -v spirv-val >/dev/null; then
+    for shader in src/shaders/*.spv; do
+        spirv-val --target-env vulkan1.2 "$shader"
+    done
+fi
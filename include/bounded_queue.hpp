@@ -0,0 +1,65 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+// FIFO with a fixed capacity, producers block while it is full.
+// Consumers never block so this is safe to drain from the render thread.
+template <typename T> class BoundedQueue {
+public:
+  explicit BoundedQueue(size_t capacity) : capacity(capacity) {}
+
+  // Returns false if the queue was closed while waiting for room
+  bool push(T item) {
+    std::unique_lock<std::mutex> lock(mutex);
+    not_full.wait(lock, [this] { return closed || items.size() < capacity; });
+    if (closed) {
+      return false;
+    }
+    items.push_back(std::move(item));
+    return true;
+  }
+
+  bool try_pop(T &item) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (items.empty()) {
+      return false;
+    }
+    item = std::move(items.front());
+    items.pop_front();
+    not_full.notify_one();
+    return true;
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    items.clear();
+    not_full.notify_all();
+  }
+
+  // Wakes up every blocked producer, further pushes are rejected
+  void close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = true;
+    not_full.notify_all();
+  }
+
+  void reopen() {
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = false;
+  }
+
+  size_t size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return items.size();
+  }
+
+private:
+  size_t capacity;
+  std::deque<T> items;
+  std::mutex mutex;
+  std::condition_variable not_full;
+  bool closed = false;
+};
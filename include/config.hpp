@@ -1,3 +1,64 @@
 #pragma once
 
+#include <cstddef>
+
 static float physics_tick_rate = 60;
+
+// Photo ingest
+static size_t thumbnail_queue_capacity = 64;
+static size_t thumbnail_uploads_per_frame = 16;
+// Photos the directory scanner hands to the grid at once
+static size_t scan_batch_size = 256;
+// Rows past the visible ones whose thumbnails get requested early, only in
+// the direction the grid is scrolling
+static int thumbnail_prefetch_rows = 2;
+// Widths of the thumbnail pyramid levels, smallest first. Each photo only
+// gets the levels its grid cell actually needs.
+const int thumbnail_level_count = 3;
+static int thumbnail_level_widths[thumbnail_level_count] = {256, 512, 1024};
+// Times a photo's thumbnail is requested again after failing to decode or
+// upload before the grid gives up on it
+static int thumbnail_max_attempts = 3;
+// GPU memory photo thumbnails may use before the least recently drawn get
+// evicted
+static size_t thumbnail_vram_budget = 512 * 1024 * 1024;
+// The thumbnail cache's pack gets rewritten without replaced and deleted
+// thumbnails once they take up this much and over a quarter of it
+static size_t thumbnail_cache_compact_bytes = 64 * 1024 * 1024;
+// Photos changed more recently than this get read instead of mmapped, they
+// may still be getting copied in and a mapping would fault if they shrink
+static int mapped_file_settle_seconds = 10;
+// How much of each file is scanned for embedded previews
+static size_t exif_header_bytes = 128 * 1024;
+
+// Loupe view
+static int loupe_tile_size = 512;
+static unsigned int loupe_worker_count = 2;
+// GPU memory for full resolution tiles, 512px tiles are 1 MiB each
+static size_t loupe_tile_budget = 96 * 1024 * 1024;
+// Decodes of a tile that may fail before it's left blank
+static int loupe_tile_max_attempts = 3;
+
+// Finalize, copies between filesystems
+// Files copied at once, each with its own buffer
+static unsigned int copy_files_in_flight = 4;
+static size_t copy_buffer_size = 4 * 1024 * 1024;
+// Read every copy back and compare checksums before removing the original
+static bool copy_verify_checksum = true;
+
+// Selections
+// Toggles reach the sidecar right away, an fsync follows at most this often
+static int selection_sync_interval_ms = 2000;
+
+// Rendering
+// Queued draws a draw may be moved back past to join a batch with the same
+// pipeline and texture, as long as it overlaps none of them
+static int draw_batch_lookback = 64;
+// Width and height of the glyph atlas texture
+static int glyph_atlas_size = 1024;
+// Text taller than this in pixels gets scaled up from glyphs this size
+static int glyph_max_pixel_size = 128;
+// Glyphs as signed distance fields, rasterized once at glyph_sdf_pixel_size
+// and drawn sharp at every size and pixel density
+static bool glyph_sdf = true;
+static int glyph_sdf_pixel_size = 48;
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <system_error>
+#include <vector>
+
+#include "finalize_journal.hpp"
+
+// Copies a batch of files between filesystems with several of them in
+// flight. copy_file_range gets the first try, then io_uring where the kernel
+// allows it and a pool of threads otherwise. Each copy is written to a .part
+// file, checked against the source's size (and checksum, see
+// copy_verify_checksum) and only then renamed into place, never over an
+// existing file. Sources are left alone.
+namespace CopyEngine {
+struct Stats {
+  uint64_t bytes = 0;
+  double seconds = 0.0;
+  const char *backend = "";
+};
+
+// Called once per file as it finishes, from whichever thread finished it
+using DoneCallback = std::function<void(size_t index, bool copied)>;
+
+// Blocks until every file is done, bytes_done grows as data gets written
+Stats copy_files(const std::vector<FileMove> &files,
+                 std::atomic<uint64_t> &bytes_done, const DoneCallback &done);
+
+// Renames unless to already exists, which fails with file_exists instead of
+// replacing it. Fails with cross_device_link between filesystems.
+bool rename_no_replace(const std::filesystem::path &from,
+                       const std::filesystem::path &to,
+                       std::error_code &error);
+} // namespace CopyEngine
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct ScannedPhoto {
+  std::filesystem::path file_path;
+  std::filesystem::path pair_path; // Other half of a RAW+JPEG pair, or empty
+};
+
+// Lists a folder on a background thread and hands photos over in batches,
+// so the grid fills in while a slow (network) folder is still being read.
+// Files are picked by extension only, nothing gets opened. Card layouts are
+// followed one level down: <folder>/DCIM/100XXXXX or DCIM/100XXXXX.
+class DirectoryScanner {
+public:
+  ~DirectoryScanner();
+  void start(const std::filesystem::path &folder);
+  // Stops the scan and waits for the thread, found photos are dropped
+  void cancel();
+  // Appends what was found since the last call, false if there was nothing
+  bool poll(std::vector<ScannedPhoto> &photos);
+  bool is_scanning() const { return scanning; }
+
+  // JPEGs and the raws RawPreview understands, by extension
+  static bool is_photo_file(const std::filesystem::path &path);
+  // Memory card folder names, DCIM/100XXXXX
+  static bool is_dcf_folder(const std::filesystem::path &path);
+  // folder itself plus the DCF folders a scan of it descends into
+  static std::vector<std::filesystem::path>
+  photo_folders(const std::filesystem::path &folder);
+
+private:
+  void scan_main(std::filesystem::path folder);
+  void scan_folder(const std::filesystem::path &folder);
+  void publish(std::vector<ScannedPhoto> &batch);
+
+  std::thread thread;
+  std::atomic<bool> cancelled = false;
+  std::atomic<bool> scanning = false;
+  std::mutex found_mutex;
+  std::vector<ScannedPhoto> found;
+};
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Exif {
+
+// A JPEG stream embedded in another file, offsets are from the file start
+struct EmbeddedImage {
+  size_t offset;
+  size_t length;
+};
+
+// Looks for previews embedded in a JPEG's APP segments, the EXIF IFD1
+// thumbnail (APP1) and the MPF preview images (APP2). Only the header bytes
+// are needed, previews stored past the end of data (MPF usually is) are still
+// reported as long as they fit in file_size. Results are sorted smallest
+// first.
+bool find_previews(const uint8_t *data, size_t size, size_t file_size,
+                   std::vector<EmbeddedImage> &previews);
+
+} // namespace Exif
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <vector>
+
+struct FileMove {
+  std::filesystem::path from;
+  std::filesystem::path to;
+};
+
+// Append-only record of a finalize batch, so a batch cut short by a crash
+// gets finished the next time its folder is opened. Every move is written
+// and synced before the first one starts, finished moves then append a done
+// record. Replaying is safe since a move whose source is gone but whose
+// destination exists counts as done.
+// Kept in the photo folder as .finalize.journal and deleted once every move
+// in the batch went through.
+class FinalizeJournal {
+public:
+  ~FinalizeJournal();
+  static std::filesystem::path path_for(const std::filesystem::path &folder);
+  bool create(const std::filesystem::path &path,
+              const std::vector<FileMove> &moves);
+  // Thread safe, index is into the moves given to create()
+  void mark_done(size_t index);
+  // Closes and deletes the journal
+  void finish();
+  // Closes but keeps the journal, for a batch with failed moves so they get
+  // retried the next time the folder is opened
+  void close();
+  // Moves without a done record, false if there is no (valid) journal
+  static bool read_pending(const std::filesystem::path &path,
+                           std::vector<FileMove> &pending);
+
+private:
+  std::mutex mutex;
+  FILE *file = nullptr;
+  std::filesystem::path path;
+};
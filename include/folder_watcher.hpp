@@ -0,0 +1,41 @@
+#pragma once
+
+#include <filesystem>
+#include <unordered_map>
+#include <vector>
+
+struct FolderEvent {
+  enum Type {
+    FILE_WRITTEN, // New, replaced or rewritten photo
+    FILE_REMOVED,
+    RESCAN, // Events got lost, the folder has to be listed again
+  };
+  Type type;
+  std::filesystem::path path;
+};
+
+// Watches an open folder (and the same card subfolders DirectoryScanner
+// reads) for photos being added, rewritten or removed, so the grid can
+// follow along without a full rescan. Backed by inotify, on other platforms
+// it never reports anything.
+class FolderWatcher {
+public:
+  ~FolderWatcher();
+  bool watch(const std::filesystem::path &folder);
+  void stop();
+  // Appends what changed since the last call without blocking, false if
+  // nothing did
+  bool poll(std::vector<FolderEvent> &events);
+
+private:
+  struct Watch {
+    std::filesystem::path path;
+    bool photos; // Photo files in here are reported
+  };
+
+  void add_watch(const std::filesystem::path &path, bool photos);
+
+  int fd = -1;
+  std::unordered_map<int, Watch> watches; // By watch descriptor
+  std::vector<char> read_buffer;
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "SDL3/SDL_gpu.h"
+#include "SDL3_ttf/SDL_ttf.h"
+#include "glm/glm.hpp"
+
+// Glyphs rasterized on first use into one texture, keyed by font, codepoint
+// and pixel size bucket. Glyphs of similar height share a shelf, when the
+// atlas is full the least recently drawn shelf gets cleared for reuse.
+// Only the parts of shelves that changed get uploaded. With glyph_sdf the
+// glyphs are distance fields at a single size, for text_sdf.frag.
+class GlyphAtlas {
+public:
+  // Pixels are at the bucket size, scale by point size / bucket
+  struct Glyph {
+    glm::vec4 uv_rect; // Zero sized for blank glyphs like spaces
+    glm::vec2 offset;  // Top left corner from the pen, y from the line top
+    glm::vec2 size;
+    float advance;
+    int shelf; // -1 for blank glyphs
+  };
+
+  // Same units as Glyph
+  struct LineMetrics {
+    float ascent;
+    float height;
+  };
+
+  ~GlyphAtlas();
+  // Font ids are indices into font_paths
+  bool init(SDL_GPUDevice *device, const std::vector<std::string> &font_paths);
+  void cleanup();
+  // Glyphs used since the last begin_frame are never evicted
+  void begin_frame();
+  // Size glyphs get rasterized at for text pixel_size pixels tall
+  static int size_bucket(float pixel_size);
+  // nullptr if the font can't be opened or the atlas is full of glyphs
+  // drawn this frame
+  const Glyph *find(uint16_t font_id, int bucket, uint32_t codepoint);
+  bool line_metrics(uint16_t font_id, int bucket, LineMetrics &metrics);
+  bool has_dirty_regions() const;
+  // Records the uploads into copy_pass, must happen before the frame's draws
+  void upload(SDL_GPUCopyPass *copy_pass);
+  SDL_GPUTexture *get_texture() const { return texture; }
+
+private:
+  struct Shelf {
+    int y;
+    int height;
+    int x; // Next free column
+    uint64_t last_used_frame;
+    int dirty_begin; // Columns changed since the last upload
+    int dirty_end;
+    std::vector<uint64_t> glyphs;
+  };
+
+  struct SizedFont {
+    TTF_Font *font;
+    LineMetrics metrics;
+  };
+
+  SizedFont *find_font(uint16_t font_id, int bucket);
+  bool rasterize(SizedFont &font, uint32_t codepoint, Glyph &glyph);
+  int allocate(int width, int height, int &x);
+  void clear_shelf(Shelf &shelf);
+
+  SDL_GPUDevice *device = nullptr;
+  SDL_GPUTexture *texture = nullptr;
+  SDL_GPUTransferBuffer *transfer_buffer = nullptr;
+  int size = 0;
+  std::vector<uint32_t> pixels; // ABGR8888 copy of the whole atlas
+
+  std::vector<std::string> font_paths;
+  std::unordered_map<uint32_t, SizedFont> fonts; // font id << 16 | bucket
+  std::unordered_map<uint64_t, Glyph> glyphs;
+  std::vector<Shelf> shelves; // Top to bottom
+  uint64_t frame = 0;
+  bool full_logged = false;
+};
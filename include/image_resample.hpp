@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+
+namespace ImageResample {
+
+// Box filter for 4 channel, 8-bit pixels. Every destination pixel is the
+// average of the source pixels it covers, so large reductions don't alias
+// the way bilinear does. Upscaling falls back to nearest neighbour.
+void downscale_rgba8(const uint8_t *src, int src_width, int src_height,
+                     int src_pitch, uint8_t *dst, int dst_width,
+                     int dst_height);
+
+} // namespace ImageResample
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "turbojpeg.h"
+
+#include "exif.hpp"
+#include "thumbnail.hpp"
+
+// Decodes JPEGs into thumbnails. Owns a TurboJPEG handle and grow-only
+// scratch buffers that are reused from photo to photo, so once the buffers
+// have grown to the biggest photo seen, decoding does no heap allocations.
+// Not thread safe, each worker thread keeps its own.
+class JpegDecoder {
+public:
+  JpegDecoder();
+  ~JpegDecoder();
+  JpegDecoder(const JpegDecoder &) = delete;
+  JpegDecoder &operator=(const JpegDecoder &) = delete;
+
+  // Decodes to target_width pixels wide, keeping the aspect ratio. Embedded
+  // previews are used when big enough, otherwise the JPEG is decoded at the
+  // smallest DCT scaling factor that still covers target_width, then
+  // resampled. Raw files go through their embedded JPEG previews instead.
+  // thumbnail.pixels is resized but keeps its capacity.
+  bool decode_thumbnail(const std::filesystem::path &path, int target_width,
+                        Thumbnail &thumbnail);
+  bool read_header(const unsigned char *jpeg_buffer, size_t jpeg_size,
+                   int &width, int &height);
+  // Decodes a full resolution region into tightly packed ABGR8888 pixels.
+  // Uses TurboJPEG's cropping, so only the MCU rows and columns covering the
+  // region get decoded. pixels is resized but keeps its capacity.
+  bool decode_region(const unsigned char *jpeg_buffer, size_t jpeg_size, int x,
+                     int y, int width, int height,
+                     std::vector<uint8_t> &pixels);
+
+private:
+  bool decode_buffer(const unsigned char *jpeg_buffer, size_t jpeg_size,
+                     const std::filesystem::path &path, int target_width,
+                     Thumbnail &thumbnail);
+
+  tjhandle handle;
+  std::vector<Exif::EmbeddedImage> previews;
+  // Holds files too recently changed to mmap, see MappedFile
+  std::vector<uint8_t> file_buffer;
+  std::vector<uint8_t> decode_buffer_8bit;
+  std::vector<uint16_t> decode_buffer_16bit;
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "glm/vec2.hpp"
+
+#include "bounded_queue.hpp"
+#include "mapped_file.hpp"
+#include "renderer.hpp"
+#include "texture_residency.hpp"
+
+struct LoupeTileJob {
+  int column;
+  int row;
+  uint32_t generation;
+  std::shared_ptr<const MappedFile> file; // Keeps the mapping alive
+  size_t jpeg_offset;
+  size_t jpeg_length;
+};
+
+struct LoupeTile {
+  int column;
+  int row;
+  uint32_t generation;
+  int width;
+  int height;
+  std::vector<uint8_t> pixels; // ABGR8888, tightly packed
+  bool failed;                 // Couldn't be decoded, pixels is empty
+};
+
+// Shows a single photo at 100% for focus checking. The image is split into
+// fixed size tiles and only the ones on screen (plus a ring around them) get
+// decoded, straight from the memory mapped JPEG using region decoding. Tiles
+// stay on the GPU in an LRU cache, so the full image is never held anywhere.
+// Raws are shown through their largest embedded JPEG preview.
+class LoupeView {
+public:
+  LoupeView();
+  ~LoupeView();
+  bool start(unsigned int worker_count);
+  void stop();
+  bool open(Renderer &renderer, const std::filesystem::path &path);
+  void close(Renderer &renderer);
+  bool is_open() const { return file != nullptr; }
+  // Moves the view by delta physical pixels
+  void pan(glm::vec2 delta);
+  // Uploads finished tiles, queues missing ones and draws the view. Call
+  // inside the frame, after everything it should cover.
+  void draw(Renderer &renderer);
+
+private:
+  enum TileState : uint8_t {
+    TILE_MISSING,
+    TILE_REQUESTED,
+    TILE_RESIDENT,
+    TILE_FAILED, // Out of attempts, stays blank
+  };
+
+  void worker_main();
+  void upload_ready(Renderer &renderer);
+  void tile_failed(size_t key);
+  void destroy_tiles(Renderer &renderer);
+
+  std::vector<std::thread> workers;
+  std::deque<LoupeTileJob> jobs;
+  std::mutex jobs_mutex;
+  std::condition_variable jobs_available;
+  BoundedQueue<LoupeTile> results;
+  bool running = false;
+  uint32_t generation = 0;
+
+  std::shared_ptr<const MappedFile> file;
+  // The JPEG inside file, all of it unless file is a raw
+  size_t jpeg_offset = 0;
+  size_t jpeg_length = 0;
+  int image_width = 0;
+  int image_height = 0;
+  int columns = 0;
+  int rows = 0;
+  glm::vec2 center = glm::vec2(0.0f); // In image pixels
+
+  std::vector<TileState> tile_states;
+  std::vector<uint8_t> tile_failures;
+  std::vector<std::string> tile_names; // Texture names, built on open()
+  TextureResidency residency;
+
+  // Reused every frame
+  std::vector<LoupeTile> ready;
+  std::vector<TextureUpload> uploads;
+  std::vector<size_t> evicted;
+};
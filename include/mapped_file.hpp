@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// Read only view of a whole file. Uses mmap where available so pages are
+// only read in when they are touched. Files that changed in the last
+// mapped_file_settle_seconds, or while being mapped, are read into memory
+// instead: a write or truncate under a mapping turns the next page touched
+// into SIGBUS, and the folder is watched so photos show up mid-copy.
+class MappedFile {
+public:
+  MappedFile() = default;
+  ~MappedFile();
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  // Files that get read instead of mapped go into scratch when given one, so
+  // callers can reuse a buffer. scratch has to outlive the view.
+  bool open(const std::filesystem::path &path,
+            std::vector<uint8_t> *scratch = nullptr);
+  // Always maps, for files only this process writes and only ever appends to
+  bool open_stable(const std::filesystem::path &path);
+  void close();
+  bool is_open() const { return mapped_data != nullptr; }
+  const uint8_t *data() const { return mapped_data; }
+  size_t size() const { return mapped_size; }
+
+  // Readahead hints for the kernel, no-ops where mmap isn't available
+  void advise_random();
+  void advise_sequential();
+  void prefetch(size_t offset, size_t length); // Starts reading in the range
+
+private:
+  bool open_file(const std::filesystem::path &path,
+                 std::vector<uint8_t> *scratch, bool stable);
+
+  uint8_t *mapped_data = nullptr;
+  size_t mapped_size = 0;
+  bool mapped = false; // Otherwise mapped_data points into a read buffer
+  std::vector<uint8_t> fallback_buffer; // Read buffer without a scratch
+};
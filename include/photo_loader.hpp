@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.hpp"
+#include "renderer.hpp"
+#include "thumbnail.hpp"
+#include "thumbnail_cache.hpp"
+
+struct ThumbnailJob {
+  size_t index;
+  int level; // Index into thumbnail_level_widths
+  uint32_t generation;
+  std::filesystem::path file_path;
+};
+
+struct ThumbnailResult {
+  size_t index;
+  int level;
+  uint32_t generation;
+  std::filesystem::path file_path; // Also the texture name
+  Thumbnail thumbnail;
+  CachedThumbnail cached; // Used instead of thumbnail on a cache hit
+  bool failed;            // Couldn't be decoded, nothing to upload
+};
+
+struct LoadedThumbnail {
+  size_t index;
+  int level;
+  size_t bytes; // Size of the GPU texture
+  bool failed;  // Decoding or uploading failed, the photo can be asked again
+};
+
+// Reads and decodes thumbnails on a pool of worker threads. Decoded results
+// wait in a bounded queue until the render thread uploads them, so memory use
+// stays flat no matter how big the folder is.
+class PhotoLoader {
+public:
+  PhotoLoader();
+  ~PhotoLoader();
+  bool start(unsigned int worker_count = 0); // 0 picks the core count
+  void stop();
+  // Call after cancel() and before queueing the folder's photos
+  bool open_cache(const std::filesystem::path &folder);
+  void enqueue(size_t index, int level, std::filesystem::path file_path);
+  // Drops every pending job and every result that wasn't uploaded yet
+  void cancel();
+  // Drops queued jobs for photos outside [begin, end) that no worker picked up
+  // yet, their indices get appended to dropped so they can be requested again
+  void drop_pending_outside(size_t begin, size_t end,
+                            std::vector<size_t> &dropped);
+  // Uploads at most max_uploads thumbnails in a single copy pass and returns
+  // the photos that are now drawable or failed, valid until the next call
+  const std::vector<LoadedThumbnail> &upload_ready(Renderer &renderer,
+                                                   size_t max_uploads);
+  bool is_idle();
+
+private:
+  void worker_main();
+  // Pixel buffers travel worker -> render thread -> back here, so
+  // thumbnails don't cost an allocation each once the pool has warmed up
+  std::vector<uint8_t> take_pixel_buffer();
+  void recycle_pixel_buffer(std::vector<uint8_t> &&buffer);
+
+  std::vector<std::thread> workers;
+  std::deque<ThumbnailJob> jobs;
+  std::mutex jobs_mutex;
+  std::condition_variable jobs_available;
+  BoundedQueue<ThumbnailResult> results;
+  ThumbnailCache cache;
+  // Held while storing, so a folder switch can't happen between checking a
+  // job's generation and writing its thumbnail
+  std::mutex cache_mutex;
+
+  std::vector<std::vector<uint8_t>> spare_pixel_buffers;
+  std::mutex spare_pixel_buffers_mutex;
+
+  // Reused by upload_ready() every frame
+  std::vector<ThumbnailResult> ready;
+  std::vector<TextureUpload> uploads;
+  std::vector<LoadedThumbnail> loaded;
+  std::vector<LoadedThumbnail> failed;
+
+  std::atomic<uint32_t> generation = 0;
+  std::atomic<int> busy_workers = 0;
+  bool running = false;
+  // Set by open_cache(), the next worker out of jobs runs cache.prune()
+  bool prune_cache = false;
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+#include "finalize_journal.hpp"
+
+// Moves finalized photos into place on a background thread. A move within
+// one filesystem is a rename, anything else goes through CopyEngine and the
+// original is removed once the copy checks out. Nothing gets replaced, a
+// destination that is taken gets a number appended. Batches are journaled
+// (see FinalizeJournal) with those final destinations so they can be resumed
+// after a crash.
+class PhotoMover {
+public:
+  struct Progress {
+    size_t files_done;
+    size_t file_count;
+    uint64_t bytes_done;
+    uint64_t byte_count;
+    double bytes_per_second;
+    size_t failed;
+  };
+
+  ~PhotoMover();
+  // false if a batch is still being moved. journal_path is where the batch
+  // gets journaled, pass the same one and resumed to resume an interrupted
+  // batch, whose destinations are already final.
+  bool start(std::vector<FileMove> moves,
+             const std::filesystem::path &journal_path, bool resumed = false);
+  // Waits for the current batch to finish
+  void wait();
+  bool is_busy() const { return busy; }
+  Progress get_progress() const;
+
+private:
+  void move_main();
+  void add_moved_bytes(const std::filesystem::path &path);
+
+  std::thread thread;
+  std::vector<FileMove> moves;
+  FinalizeJournal journal;
+  std::filesystem::path journal_path;
+  bool resumed = false;
+  std::atomic<bool> busy = false;
+  std::atomic<size_t> files_done = 0;
+  std::atomic<size_t> failed = 0;
+  std::atomic<uint64_t> bytes_done = 0;
+  std::atomic<uint64_t> byte_count = 0;
+  std::chrono::steady_clock::time_point start_time;
+};
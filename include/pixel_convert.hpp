@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Converts 12/16-bit RGBA samples (as TurboJPEG outputs them for high
+// precision JPEGs) down to ABGR8888. Kernels are picked at runtime from what
+// the CPU supports, the scalar one always works.
+namespace PixelConvert {
+
+enum Kernel {
+  KERNEL_SCALAR,
+  KERNEL_SSE2,
+  KERNEL_AVX2,
+  KERNEL_NEON,
+  KERNEL_COUNT,
+};
+
+const char *kernel_name(Kernel kernel);
+bool kernel_supported(Kernel kernel);
+// Fastest supported kernel, detected once
+Kernel best_kernel();
+
+// Shifts precision bit samples down to 8 bits, all 4 channels
+void rgba16_to_rgba8(const uint16_t *src, uint8_t *dst, size_t pixel_count,
+                     int precision, Kernel kernel = best_kernel());
+
+// Same conversion fused with a 2x2 box downscale, so a full size 16-bit
+// decode is read once instead of being converted and then resampled. dst is
+// (src_width / 2) x (src_height / 2), an odd last row or column is dropped.
+void rgba16_to_rgba8_half(const uint16_t *src, int src_width, int src_height,
+                          uint8_t *dst, int precision,
+                          Kernel kernel = best_kernel());
+
+} // namespace PixelConvert
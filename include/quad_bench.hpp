@@ -0,0 +1,13 @@
+#pragma once
+
+#include "renderer.hpp"
+
+// Grid of color rects, texture rects, arcs and labels at growing item counts,
+// logs the CPU time from the first draw call to submission. Run with
+// --bench-quads.
+namespace QuadBench {
+
+// False if the window got closed before it finished
+bool run(Renderer &renderer);
+
+} // namespace QuadBench
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "exif.hpp"
+
+namespace RawPreview {
+
+// True for the raw extensions below, case insensitive
+bool is_raw(const std::filesystem::path &path);
+
+// Locates the JPEG previews camera raws carry next to the sensor data:
+//  - RAF: offset and length in the big endian header
+//  - NEF/ARW/DNG/CR2 (TIFF): JPEG tags and JPEG compressed strips in every
+//    IFD and SubIFD
+//  - CR3 (ISO BMFF): the full size JPEG track and the PRVW box
+// data has to cover the whole file since previews can sit anywhere in it,
+// with a mapping only the pages that get parsed are read in. Results are
+// sorted smallest first.
+bool find_previews(const uint8_t *data, size_t size,
+                   std::vector<Exif::EmbeddedImage> &previews);
+
+} // namespace RawPreview
@@ -2,11 +2,15 @@
 
 #include <string>
 #include <cstdint>
+#include <unordered_map>
+#include <vector>
 
 #include "SDL3/SDL_gpu.h"
 #include "SDL3/SDL_video.h"
 #include "glm/mat4x4.hpp"
 
+#include "glyph_atlas.hpp"
+
 struct Context {
   SDL_Window *window;
   SDL_GPUDevice *device;
@@ -19,6 +23,29 @@ struct Vertex {
   float u, v;       // vec2 texture coordinates
 };
 
+// Raw pixels for Renderer::load_textures
+struct TextureUpload {
+  std::string path;
+  int level = -1; // Pyramid level, -1 for a plain texture
+  int width;
+  int height;
+  const void *pixels; // ABGR8888, tightly packed
+};
+
+// A texture stored at a few sizes under one path, draw_texture_rect picks
+// the level closest to the size on screen
+const int MAX_TEXTURE_LEVELS = 4;
+struct TexturePyramid {
+  SDL_GPUTexture *levels[MAX_TEXTURE_LEVELS] = {};
+  int widths[MAX_TEXTURE_LEVELS] = {};
+};
+
+// Smallest available level at least pixel_width wide, otherwise the largest
+// available one. Bit i of available_levels is set when level i exists.
+// Returns -1 if none are available.
+int choose_texture_level(const int *widths, int level_count,
+                         uint32_t available_levels, float pixel_width);
+
 const int WIDTH = 1280;
 const int HEIGHT = 720;
 
@@ -27,12 +54,10 @@ struct BasicVertexUniformBuffer {
   glm::mat4 mvp_matrix;
 };
 
-struct TextVertexUniformBuffer {
-  glm::mat4 mvp_matrix;
-  float time;
-  float offset;
-  float padding1;
-  float padding2;
+struct QuadVertexUniformBuffer {
+  glm::mat4 projection_matrix;
+  uint32_t first_instance;
+  uint32_t padding[3];
 };
 
 // Fragment uniform blocks
@@ -41,40 +66,55 @@ struct SpriteFragmentUniformBuffer {
   float time;
 };
 
-struct ColorRectFragmentUniformBuffer {
-  glm::vec4 size;
-  glm::vec4 modulate;
-  glm::vec4 corner_radii;
-};
-
-struct TextureRectFragmentUniformBuffer {
-  glm::vec4 size;
-  glm::vec4 modulate;
+// One color rect, texture rect, arc or glyph in the frame's storage buffer,
+// the instanced pipelines draw whole batches of these at once. Matches Quad
+// in quad.vert.
+struct QuadInstance {
+  glm::vec4 rect; // Bottom left corner and size, y up like the projection
+  glm::vec4 color;
   glm::vec4 corner_radii;
-  uint32_t tiling;
+  glm::vec4 uv_rect;
+  glm::vec4 params; // Tiling, arc thickness, rotation in radians, texture slot
 };
 
-struct TextFragmentUniformBuffer {
-  glm::vec4 modulate;
-  glm::vec4 uv_rect;
+// Textures a single instanced draw can sample from
+const int QUAD_TEXTURE_SLOTS = 8;
+
+const size_t MAX_VERTEX_UNIFORM_SIZE = sizeof(BasicVertexUniformBuffer);
+const size_t MAX_FRAGMENT_UNIFORM_SIZE = sizeof(SpriteFragmentUniformBuffer);
+
+// A draw_* call recorded for flush(), with its uniforms or instance data
+// copied in
+struct DrawCommand {
+  SDL_GPUGraphicsPipeline *pipeline;
+  SDL_GPUTexture *texture; // nullptr if the pipeline samples nothing
+  SDL_GPUSampler *sampler;
+  uint32_t scissor; // Index into the frame's scissor rects
+  glm::vec4 bounds; // min x, min y, max x, max y in layout units
+  uint32_t vertex_uniform_size;
+  uint32_t fragment_uniform_size;
+  alignas(16) uint8_t vertex_uniforms[MAX_VERTEX_UNIFORM_SIZE];
+  alignas(16) uint8_t fragment_uniforms[MAX_FRAGMENT_UNIFORM_SIZE];
+  bool instanced;
+  // Range of queued_instances, a whole string for text
+  uint32_t first_instance;
+  uint32_t instance_count;
 };
 
-struct ArcFragmentUniformBuffer {
-  glm::vec4 modulate;
-  float radius;
-  float thickness;
-  float padding1;
-  float padding2;
+// What flush() sent to the GPU over one frame
+struct RenderStats {
+  uint32_t commands; // Queued draw_* calls
+  uint32_t draws;
+  uint32_t instances; // Quads and glyphs drawn through instanced pipelines
+  uint32_t pipeline_binds;
+  uint32_t sampler_binds;
+  uint32_t uniform_pushes;
+  uint32_t scissor_changes;
 };
 
 static BasicVertexUniformBuffer basic_vertex_uniform_buffer{};
-static TextVertexUniformBuffer text_vertex_uniform_buffer{};
 
 static SpriteFragmentUniformBuffer sprite_fragment_uniform_buffer{};
-static ColorRectFragmentUniformBuffer color_rect_fragment_uniform_buffer{};
-static TextureRectFragmentUniformBuffer texture_rect_fragment_uniform_buffer{};
-static TextFragmentUniformBuffer text_fragment_uniform_buffer{};
-static ArcFragmentUniformBuffer arc_fragment_uniform_buffer{};
 
 class Renderer {
 public:
@@ -84,6 +124,15 @@ public:
   Renderer();
   ~Renderer();
   bool load_texture(std::string path, SDL_Surface *image_data);
+  bool load_textures(const std::vector<TextureUpload> &uploads);
+  // Safe to call mid frame, the GPU keeps the texture alive until it is done.
+  // Frees every pyramid level stored under path too.
+  bool destroy_texture(const std::string &path);
+  bool destroy_texture_level(const std::string &path, int level);
+  // Level draw_texture_rect samples for a texture drawn width layout units
+  // wide. Callers deciding which levels to load ask this too so both agree.
+  int texture_level(const int *widths, int level_count,
+                    uint32_t available_levels, float width) const;
   bool load_geometry(std::string path, const Vertex *vertices,
                      size_t vertex_size, const Uint16 *indices,
                      size_t index_size);
@@ -91,32 +140,66 @@ public:
                                 SDL_GPUShader *fragment_shader);
   bool init();
   bool begin_frame();
+  // Submits the queued draws, end_frame calls it too
+  bool flush();
   bool end_frame();
-  // Drawing functions
+  // Last finished frame
+  const RenderStats &get_frame_stats() const { return last_frame_stats; }
+  // Drawing functions, these only queue the draw until flush()
   bool draw_sprite(std::string path, glm::vec2 translation, float rotation,
                    glm::vec2 scale, glm::vec4 color);
   bool draw_color_rect(glm::vec2 position, glm::vec2 size, glm::vec4 color,
                        glm::vec4 corner_radius);
   bool draw_texture_rect(std::string path, glm::vec2 position, glm::vec2 size,
                          glm::vec4 color, glm::vec4 corner_radius, bool tiling);
+  // Font ids index the fonts GlyphAtlas was given in init()
   bool draw_text(const char *text, int length, float point_size,
-                 glm::vec2 position, glm::vec4 color);
+                 glm::vec2 position, glm::vec4 color, uint16_t font_id = 0);
+  glm::vec2 measure_text(const char *text, int length, float point_size,
+                         uint16_t font_id = 0);
   bool draw_arc(glm::vec2 position, float radius, float thickness,
                 float rotation, glm::vec4 color);
   bool begin_scissor_mode(glm::ivec2 pos, glm::ivec2 size);
   bool end_scissor_mode();
   bool cleanup();
-  glm::vec2 glyph_size;
-  float font_sample_point_size = 64.0f;
   float viewport_scale = 2.0f;
 
 private:
+  // Queued draws in a row sharing pipeline, texture and sampler. Instanced
+  // batches can mix up to QUAD_TEXTURE_SLOTS textures.
+  struct DrawBatch {
+    uint32_t first; // Further commands follow through next_in_batch
+    uint32_t last;
+    uint32_t scissor;
+    uint32_t first_instance;
+    uint32_t instance_count;
+    int slot_count;
+    SDL_GPUTextureSamplerBinding slots[QUAD_TEXTURE_SLOTS];
+  };
+
+  SDL_GPUTexture *find_texture(const std::string &path, float width);
+  void release_texture(SDL_GPUTexture *texture);
+  template <typename VertexUniforms, typename FragmentUniforms>
+  void queue_draw(SDL_GPUGraphicsPipeline *pipeline, SDL_GPUTexture *texture,
+                  SDL_GPUSampler *sampler, glm::vec4 bounds,
+                  const VertexUniforms &vertex_uniforms,
+                  const FragmentUniforms &fragment_uniforms);
+  // Takes the instances pushed to queued_instances since first_instance
+  void queue_quads(SDL_GPUGraphicsPipeline *pipeline, SDL_GPUTexture *texture,
+                   SDL_GPUSampler *sampler, glm::vec4 bounds,
+                   uint32_t first_instance);
+  int batch_slot(const DrawBatch &batch, const DrawCommand &command) const;
+  void batch_draw_commands();
+  bool upload_frame_data();
+  bool begin_render_pass();
+
   Context context;
 
   std::unordered_map<std::string, SDL_GPUGraphicsPipeline *> graphics_pipelines;
   std::unordered_map<std::string, SDL_GPUBuffer *> vertex_buffers;
   std::unordered_map<std::string, SDL_GPUBuffer *> index_buffers;
   std::unordered_map<std::string, SDL_GPUTexture *> gpu_textures;
+  std::unordered_map<std::string, TexturePyramid> texture_pyramids;
 
   // TODO: Have support for multiple samplers
   SDL_GPUSampler *clamp_sampler;
@@ -124,6 +207,26 @@ private:
 
   SDL_GPURenderPass *_render_pass;
   SDL_GPUCommandBuffer *_command_buffer;
+  SDL_GPUTexture *_swapchain_texture;
+  // Later render passes in the frame load what the earlier ones drew
+  bool frame_cleared = false;
 
   glm::mat4 projection_matrix;
+
+  std::vector<DrawCommand> draw_commands;
+  std::vector<uint32_t> next_in_batch;
+  std::vector<DrawBatch> draw_batches;
+  std::vector<QuadInstance> queued_instances; // In draw call order
+  std::vector<QuadInstance> quad_instances;   // Grouped by batch for upload
+  SDL_GPUBuffer *quad_buffer = nullptr;
+  SDL_GPUTransferBuffer *quad_transfer_buffer = nullptr;
+  uint32_t quad_buffer_capacity = 0; // In bytes
+  GlyphAtlas glyph_atlas;
+  // Every begin/end_scissor_mode adds one, commands refer to them by index
+  std::vector<SDL_Rect> scissor_rects;
+  SDL_Rect applied_scissor;
+  bool scissor_applied = false;
+
+  RenderStats frame_stats = {};
+  RenderStats last_frame_stats = {};
 };
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Which photos are selected, one bit per grid index, with a running count so
+// the tally never has to walk the photos
+class SelectionSet {
+public:
+  void push_back(bool selected);
+  // Moves every later index down by one, like std::vector::erase
+  void erase(size_t index);
+  void clear();
+  bool test(size_t index) const {
+    return (words[index / 64] >> (index % 64)) & 1;
+  }
+  void set(size_t index, bool selected);
+  size_t size() const { return bit_count; }
+  size_t count() const { return selected_count; }
+
+private:
+  std::vector<uint64_t> words;
+  size_t bit_count = 0;
+  size_t selected_count = 0;
+};
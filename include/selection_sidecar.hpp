@@ -0,0 +1,45 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Remembers which photos of a folder are selected across restarts. Kept in
+// the folder as .selection: a header, a bitset with one bit per id, then an
+// append-only table of the names those ids stand for. A toggle rewrites the
+// one byte its bit lives in, new names get appended, the file is only
+// rewritten as a whole when the bitset has to grow.
+// Names are paths relative to the folder without the extension, so both
+// halves of a RAW+JPEG pair share a bit.
+class SelectionSidecar {
+public:
+  ~SelectionSidecar();
+  bool open(const std::filesystem::path &folder);
+  void close();
+  // Closes and deletes the sidecar, after its photos got finalized
+  void remove();
+  // Id of the photo at file_path, added to the table if it's new
+  uint32_t find_or_add(const std::filesystem::path &file_path);
+  bool is_selected(uint32_t id) const;
+  void set_selected(uint32_t id, bool selected);
+  // Call once per frame, writes are synced in batches
+  void sync_if_due();
+
+private:
+  bool rewrite(uint32_t capacity);
+  void sync();
+
+  FILE *file = nullptr;
+  std::filesystem::path folder;
+  std::filesystem::path path;
+  uint32_t capacity = 0; // Bits in the on disk bitset
+  std::vector<uint8_t> bits;
+  std::vector<std::string> names; // By id
+  std::unordered_map<std::string, uint32_t> ids;
+  bool dirty = false;
+  std::chrono::steady_clock::time_point last_sync;
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+// Keeps track of which thumbnail textures are on the GPU, under a key the
+// caller picks, and evicts the least recently drawn ones once their total
+// size goes over a budget.
+// Evicted thumbnails come back through the loader (and its disk cache) the
+// next time they scroll into view.
+class TextureResidency {
+public:
+  struct Stats {
+    uint64_t hits = 0;   // First draw of a texture since it became resident
+    uint64_t misses = 0; // Loads requested for something wanted on screen
+    uint64_t evictions = 0;
+    size_t resident_bytes = 0;
+    size_t resident_count = 0;
+  };
+
+  explicit TextureResidency(size_t budget_bytes);
+  void set_budget(size_t budget_bytes);
+  // Call once per frame before any touch()
+  void begin_frame();
+  void add(size_t key, size_t bytes);
+  // Marks the thumbnail as drawn this frame, returns false if not resident
+  bool touch(size_t key);
+  // Call when something on screen wasn't resident and a load got requested
+  void count_miss() { stats.misses++; }
+  // Evicts entries that weren't drawn this frame until under budget, their
+  // keys get appended to evicted
+  void evict(std::vector<size_t> &evicted);
+  // Forgets an entry whose texture the caller already released
+  void remove(size_t key);
+  // Forgets keys in [first_key, first_key + count) and moves every key after
+  // them down by count, for items erased from the middle of a list
+  void erase_range(size_t first_key, size_t count);
+  void clear();
+  const Stats &get_stats() const { return stats; }
+
+private:
+  struct Entry {
+    size_t key;
+    size_t bytes;
+    uint64_t last_drawn_frame;
+    bool drawn; // Since it was added, for counting hits
+  };
+
+  std::list<Entry> lru; // Most recently drawn first
+  std::unordered_map<size_t, std::list<Entry>::iterator> entries;
+  size_t budget_bytes;
+  uint64_t frame = 0;
+  Stats stats;
+};
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// CPU side thumbnail, ready to be uploaded as a texture
+struct Thumbnail {
+  int width = 0;
+  int height = 0;
+  std::vector<uint8_t> pixels; // ABGR8888, tightly packed
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mapped_file.hpp"
+#include "thumbnail.hpp"
+
+// Identifies one version of a file on disk
+struct FileStamp {
+  uint64_t size;
+  int64_t mtime;
+};
+
+// Points into the cache's mapping, valid until handed back with
+// ThumbnailCache::release() or the cache gets closed
+struct CachedThumbnail {
+  int width = 0;
+  int height = 0;
+  const uint8_t *pixels = nullptr; // ABGR8888, tightly packed
+  uint64_t mapping = 0; // Which of the cache's mappings, 0 for none
+};
+
+// On disk thumbnail store for one folder. Pixels live in a single append-only
+// pack file that gets memory mapped, a small index maps
+// (path, target width) -> (size, mtime, offset in pack). Opening compacts
+// the pack when enough of it is replaced or deleted thumbnails, prune()
+// records the deleted ones.
+// Files are kept in $XDG_CACHE_HOME/software-renderer/thumbnails/<folder hash>.
+// All functions are thread safe.
+class ThumbnailCache {
+public:
+  ~ThumbnailCache();
+  bool open(const std::filesystem::path &folder);
+  void close();
+  bool lookup(const std::filesystem::path &file, int target_width,
+              const FileStamp &stamp, CachedThumbnail &thumbnail);
+  // Call once the pixels of a looked up thumbnail aren't needed anymore
+  void release(CachedThumbnail &thumbnail);
+  // Forgets thumbnails of photos that were deleted. Stats every photo, so
+  // it's for a worker thread, and stops early once keep_going says so.
+  void prune(const std::function<bool()> &keep_going);
+  bool store(const std::filesystem::path &file, int target_width,
+             const FileStamp &stamp, const Thumbnail &thumbnail);
+
+  static bool get_stamp(const std::filesystem::path &file, FileStamp &stamp);
+
+private:
+  struct Entry {
+    std::filesystem::path path; // Keys are hashes, this tells collisions apart
+    FileStamp stamp;
+    uint32_t target_width;
+    uint32_t width;
+    uint32_t height;
+    uint64_t offset;
+  };
+
+  // A pack mapping and how many looked up thumbnails still point into it
+  struct Mapping {
+    std::unique_ptr<MappedFile> file;
+    uint64_t id; // Never reused, not even across close()
+    size_t users;
+  };
+
+  bool remap();
+  bool compact(const std::filesystem::path &index_path);
+
+  std::mutex mutex;
+  std::unordered_map<uint64_t, Entry> entries; // See entry_key()
+  std::ofstream pack_stream;
+  std::ofstream index_stream;
+  std::filesystem::path pack_path;
+  uint64_t pack_size = 0;
+  // The last one covers the whole pack. Older ones only stay while
+  // thumbnails looked up from them haven't been released.
+  std::vector<Mapping> mappings;
+  uint64_t next_mapping_id = 1;
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// TIFF tags shared by EXIF and the TIFF based raw formats
+namespace TiffTag {
+static const uint16_t NEW_SUBFILE_TYPE = 0x00FE;
+static const uint16_t COMPRESSION = 0x0103;
+static const uint16_t PHOTOMETRIC_INTERPRETATION = 0x0106;
+static const uint16_t STRIP_OFFSETS = 0x0111;
+static const uint16_t STRIP_BYTE_COUNTS = 0x0117;
+static const uint16_t SUB_IFDS = 0x014A;
+static const uint16_t JPEG_INTERCHANGE_FORMAT = 0x0201;
+static const uint16_t JPEG_INTERCHANGE_FORMAT_LENGTH = 0x0202;
+static const uint16_t EXIF_IFD = 0x8769;
+static const uint16_t MP_ENTRY = 0xB002;
+} // namespace TiffTag
+
+// TIFF style byte order aware reader, all offsets are relative to base
+struct TiffReader {
+  const uint8_t *base;
+  size_t size;
+  bool little_endian;
+
+  bool u16(size_t offset, uint16_t &value) const {
+    if (offset + 2 > size) {
+      return false;
+    }
+    const uint8_t *p = base + offset;
+    value = little_endian ? (p[0] | p[1] << 8) : (p[0] << 8 | p[1]);
+    return true;
+  }
+
+  bool u32(size_t offset, uint32_t &value) const {
+    if (offset + 4 > size) {
+      return false;
+    }
+    const uint8_t *p = base + offset;
+    value = little_endian
+                ? (uint32_t(p[0]) | uint32_t(p[1]) << 8 |
+                   uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24)
+                : (uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 |
+                   uint32_t(p[2]) << 8 | uint32_t(p[3]));
+    return true;
+  }
+
+  // Parses "II*\0" / "MM\0*" and returns the first IFD offset
+  bool header(uint32_t &first_ifd) {
+    if (size < 8) {
+      return false;
+    }
+    if (base[0] == 'I' && base[1] == 'I') {
+      little_endian = true;
+    } else if (base[0] == 'M' && base[1] == 'M') {
+      little_endian = false;
+    } else {
+      return false;
+    }
+    uint16_t magic;
+    return u16(2, magic) && magic == 42 && u32(4, first_ifd);
+  }
+
+  // Value (or offset to the value) of a tag in the IFD at ifd_offset
+  bool find_tag(uint32_t ifd_offset, uint16_t tag, uint32_t &value,
+                uint32_t *count = nullptr) const {
+    uint16_t entry_count;
+    if (!u16(ifd_offset, entry_count)) {
+      return false;
+    }
+    for (uint16_t i = 0; i < entry_count; i++) {
+      size_t entry = ifd_offset + 2 + i * 12;
+      uint16_t entry_tag;
+      if (!u16(entry, entry_tag)) {
+        return false;
+      }
+      if (entry_tag == tag) {
+        if (count && !u32(entry + 4, *count)) {
+          return false;
+        }
+        uint16_t type;
+        if (!u16(entry + 2, type)) {
+          return false;
+        }
+        // SHORT values are left aligned in the 4 byte field
+        if (type == 3) {
+          uint16_t short_value;
+          if (!u16(entry + 8, short_value)) {
+            return false;
+          }
+          value = short_value;
+          return true;
+        }
+        return u32(entry + 8, value);
+      }
+    }
+    return false;
+  }
+
+  bool next_ifd(uint32_t ifd_offset, uint32_t &next) const {
+    uint16_t entry_count;
+    return u16(ifd_offset, entry_count) &&
+           u32(ifd_offset + 2 + entry_count * 12, next);
+  }
+};
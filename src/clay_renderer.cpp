@@ -64,7 +64,7 @@ void render_commands(Renderer &renderer,
 
       // Draw text
       renderer.draw_text(chars, length, font_size, glm::vec2(rect.x, rect.y),
-                         color);
+                         color, render_data_text->fontId);
     } break;
     case CLAY_RENDER_COMMAND_TYPE_BORDER: {
       Clay_BorderRenderData *render_data_border =
@@ -0,0 +1,824 @@
+#include "copy_engine.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+#include "SDL3/SDL_log.h"
+#include "SDL3/SDL_stdinc.h"
+
+#include "config.hpp"
+
+#ifndef _WIN32
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <cstdio> // renameat2
+#include <linux/fs.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#ifdef _WIN32
+
+// Checked first, std::filesystem::rename replaces whatever is there
+bool CopyEngine::rename_no_replace(const std::filesystem::path &from,
+                                   const std::filesystem::path &to,
+                                   std::error_code &error) {
+  if (std::filesystem::exists(to, error) || error) {
+    if (!error) {
+      error = std::make_error_code(std::errc::file_exists);
+    }
+    return false;
+  }
+  std::filesystem::rename(from, to, error);
+  return !error;
+}
+
+CopyEngine::Stats CopyEngine::copy_files(const std::vector<FileMove> &files,
+                                         std::atomic<uint64_t> &bytes_done,
+                                         const DoneCallback &done) {
+  auto start_time = std::chrono::steady_clock::now();
+  Stats stats;
+  stats.backend = "copy_file";
+  for (size_t i = 0; i < files.size(); i++) {
+    std::error_code error;
+    std::filesystem::path part_path = files[i].to;
+    part_path += ".part";
+    uintmax_t size = std::filesystem::file_size(files[i].from, error);
+    if (!error) {
+      std::filesystem::copy_file(
+          files[i].from, part_path,
+          std::filesystem::copy_options::overwrite_existing, error);
+    }
+    bool copied = !error &&
+                  std::filesystem::file_size(part_path, error) == size &&
+                  !error && rename_no_replace(part_path, files[i].to, error);
+    if (copied) {
+      bytes_done += size;
+      stats.bytes += size;
+    } else {
+      std::filesystem::remove(part_path, error);
+    }
+    done(i, copied);
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start_time;
+  stats.seconds = elapsed.count();
+  return stats;
+}
+
+#else
+
+// 64-bit words mixed into four independent lanes, far quicker than a byte
+// at a time hash and plenty to catch a bad copy. Chunks have to be fed in
+// the same sizes for the same result, both sides of a copy use full buffers.
+static uint64_t checksum(uint64_t hash, const uint8_t *data, size_t size) {
+  const uint64_t prime = 0x9e3779b97f4a7c15ull;
+  uint64_t lanes[4] = {hash, hash ^ 1, hash ^ 2, hash ^ 3};
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    for (int lane = 0; lane < 4; lane++) {
+      uint64_t word;
+      memcpy(&word, data + i + lane * 8, 8);
+      lanes[lane] = (lanes[lane] ^ word) * prime;
+      lanes[lane] ^= lanes[lane] >> 29;
+    }
+  }
+  hash = lanes[0] ^ (lanes[1] * 3) ^ (lanes[2] * 5) ^ (lanes[3] * 7);
+  for (; i < size; i++) {
+    hash = (hash ^ data[i]) * prime;
+  }
+  return (hash ^ size) * prime;
+}
+
+// Page aligned so the kernel can hand it straight to the device
+static uint8_t *allocate_buffer() {
+  void *buffer = nullptr;
+  if (posix_memalign(&buffer, 4096, copy_buffer_size) != 0) {
+    return nullptr;
+  }
+  return static_cast<uint8_t *>(buffer);
+}
+
+// Drops the copy from the page cache so verifying reads it off the disk
+static void drop_cached(int fd) {
+#ifdef POSIX_FADV_DONTNEED
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+}
+
+// One file being copied
+struct CopySlot {
+  enum Phase {
+    READ,   // Filling buffer from the source
+    WRITE,  // Writing buffer out to the copy
+    SYNC,   // Flushing the copy to disk
+    VERIFY, // Reading the copy back
+  };
+
+  size_t index = 0;
+  int in_fd = -1;
+  int out_fd = -1;
+  struct stat source_stat;
+  std::filesystem::path part_path;
+  bool cloned = false;
+  Phase phase = READ;
+  uint64_t offset = 0; // Start of the buffer in the file
+  size_t filled = 0;   // Bytes in the buffer
+  size_t written = 0;  // Bytes of the buffer written out
+  uint64_t source_checksum = 0;
+  uint64_t copy_checksum = 0;
+  uint8_t *buffer = nullptr;
+  struct iovec iov;
+
+  size_t chunk_size() const {
+    return static_cast<size_t>(SDL_min(uint64_t(copy_buffer_size),
+                                       uint64_t(source_stat.st_size) - offset));
+  }
+};
+
+// Opens the source and a fresh .part file, the copy is done right away when
+// the filesystem can share extents (reflink)
+static bool open_copy(const FileMove &file, CopySlot &slot) {
+  slot.part_path.clear();
+  slot.in_fd = open(file.from.c_str(), O_RDONLY | O_CLOEXEC);
+  if (slot.in_fd < 0 || fstat(slot.in_fd, &slot.source_stat) < 0) {
+    SDL_Log("ERROR: opening %s: %s", file.from.c_str(), strerror(errno));
+    return false;
+  }
+  slot.part_path = file.to;
+  slot.part_path += ".part";
+  slot.out_fd = open(slot.part_path.c_str(),
+                     O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                     slot.source_stat.st_mode & 0777);
+  if (slot.out_fd < 0) {
+    SDL_Log("ERROR: creating %s: %s", slot.part_path.c_str(), strerror(errno));
+    return false;
+  }
+  // Sequential reads of the whole file, read ahead as far as possible
+#ifdef POSIX_FADV_SEQUENTIAL
+  posix_fadvise(slot.in_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+#ifdef __linux__
+  slot.cloned = ioctl(slot.out_fd, FICLONE, slot.in_fd) == 0;
+#endif
+  slot.phase = CopySlot::READ;
+  slot.offset = 0;
+  slot.filled = 0;
+  slot.written = 0;
+  slot.source_checksum = 0;
+  slot.copy_checksum = 0;
+  return true;
+}
+
+// Checks the copy and renames it into place, or throws it away
+static bool finish_copy(const FileMove &file, CopySlot &slot, bool copied) {
+  if (copied) {
+    struct stat copy_stat;
+    if (fstat(slot.out_fd, &copy_stat) < 0 ||
+        copy_stat.st_size != slot.source_stat.st_size) {
+      SDL_Log("ERROR: copy of %s has the wrong size", file.from.c_str());
+      copied = false;
+    } else if (copy_verify_checksum && !slot.cloned &&
+               slot.copy_checksum != slot.source_checksum) {
+      SDL_Log("ERROR: copy of %s doesn't match the original",
+              file.from.c_str());
+      copied = false;
+    }
+  }
+  if (copied) {
+    // Keep the capture dates, culling sorts by them
+    struct timespec times[2] = {slot.source_stat.st_atim,
+                                slot.source_stat.st_mtim};
+    futimens(slot.out_fd, times);
+    // On disk before the original gets removed
+    copied = fsync(slot.out_fd) == 0;
+  }
+  if (slot.in_fd >= 0) {
+    close(slot.in_fd);
+  }
+  if (slot.out_fd >= 0 && close(slot.out_fd) < 0) {
+    copied = false;
+  }
+  slot.in_fd = -1;
+  slot.out_fd = -1;
+  std::error_code error;
+  if (copied &&
+      !CopyEngine::rename_no_replace(slot.part_path, file.to, error)) {
+    SDL_Log("ERROR: renaming %s: %s", slot.part_path.c_str(),
+            error.message().c_str());
+    copied = false;
+  }
+  if (!copied && !slot.part_path.empty()) {
+    unlink(slot.part_path.c_str());
+  }
+  return copied;
+}
+
+// Reads until the buffer holds a full chunk, short reads are legal
+static bool read_chunk(int fd, CopySlot &slot) {
+  size_t chunk_size = slot.chunk_size();
+  while (slot.filled < chunk_size) {
+    ssize_t length = pread(fd, slot.buffer + slot.filled,
+                           chunk_size - slot.filled, slot.offset + slot.filled);
+    if (length < 0 && errno == EINTR) {
+      continue;
+    }
+    if (length <= 0) {
+      return false;
+    }
+    slot.filled += length;
+  }
+  return true;
+}
+
+// Thread pool fallback, same steps as the io_uring state machine but with
+// blocking calls
+static bool copy_blocking(const FileMove &file, CopySlot &slot,
+                          std::atomic<uint64_t> &bytes_done) {
+  if (!open_copy(file, slot)) {
+    return finish_copy(file, slot, false);
+  }
+  if (slot.cloned) {
+    bytes_done += slot.source_stat.st_size;
+    return finish_copy(file, slot, true);
+  }
+
+  uint64_t size = slot.source_stat.st_size;
+  for (slot.offset = 0; slot.offset < size; slot.offset += slot.filled) {
+    slot.filled = 0;
+    if (!read_chunk(slot.in_fd, slot)) {
+      return finish_copy(file, slot, false);
+    }
+    slot.source_checksum =
+        checksum(slot.source_checksum, slot.buffer, slot.filled);
+    for (slot.written = 0; slot.written < slot.filled;) {
+      ssize_t length =
+          pwrite(slot.out_fd, slot.buffer + slot.written,
+                 slot.filled - slot.written, slot.offset + slot.written);
+      if (length < 0 && errno == EINTR) {
+        continue;
+      }
+      if (length <= 0) {
+        return finish_copy(file, slot, false);
+      }
+      slot.written += length;
+    }
+    bytes_done += slot.filled;
+  }
+
+  if (copy_verify_checksum) {
+    if (fsync(slot.out_fd) < 0) {
+      return finish_copy(file, slot, false);
+    }
+    drop_cached(slot.out_fd);
+    for (slot.offset = 0; slot.offset < size; slot.offset += slot.filled) {
+      slot.filled = 0;
+      if (!read_chunk(slot.out_fd, slot)) {
+        return finish_copy(file, slot, false);
+      }
+      slot.copy_checksum =
+          checksum(slot.copy_checksum, slot.buffer, slot.filled);
+    }
+  }
+  return finish_copy(file, slot, true);
+}
+
+#ifdef __linux__
+
+// Lets the kernel copy, server side on NFS and SMB, without the data going
+// through user space. A failure leaves nothing counted in bytes_done.
+static bool copy_in_kernel(CopySlot &slot, std::atomic<uint64_t> &bytes_done,
+                           bool &unsupported) {
+  uint64_t size = slot.source_stat.st_size;
+  loff_t in_offset = 0;
+  loff_t out_offset = 0;
+  while (uint64_t(out_offset) < size) {
+    // Bounded so progress moves during big files
+    ssize_t length = copy_file_range(
+        slot.in_fd, &in_offset, slot.out_fd, &out_offset,
+        SDL_min(size - out_offset, uint64_t(64 * 1024 * 1024)), 0);
+    if (length < 0 && errno == EINTR) {
+      continue;
+    }
+    if (length <= 0) {
+      unsupported = length < 0 && out_offset == 0 &&
+                    (errno == EXDEV || errno == EOPNOTSUPP ||
+                     errno == ENOSYS || errno == EINVAL);
+      bytes_done -= out_offset;
+      return false;
+    }
+    bytes_done += length;
+  }
+  return true;
+}
+
+// Checksums both sides of a copy whose data never passed through here
+static bool checksum_both(CopySlot &slot) {
+  if (fsync(slot.out_fd) < 0) {
+    return false;
+  }
+  drop_cached(slot.out_fd);
+  uint64_t size = slot.source_stat.st_size;
+  for (int fd : {slot.in_fd, slot.out_fd}) {
+    uint64_t &hash =
+        fd == slot.in_fd ? slot.source_checksum : slot.copy_checksum;
+    for (slot.offset = 0; slot.offset < size; slot.offset += slot.filled) {
+      slot.filled = 0;
+      if (!read_chunk(fd, slot)) {
+        return false;
+      }
+      hash = checksum(hash, slot.buffer, slot.filled);
+    }
+  }
+  return true;
+}
+
+// copy_file_range for every file it works for, what it couldn't copy is left
+// in indices for io_uring or the threads. Once it isn't supported for one
+// file the rest skip it, they're all between the same two filesystems.
+static void copy_with_kernel(const std::vector<FileMove> &files,
+                             std::vector<size_t> &indices,
+                             std::atomic<uint64_t> &bytes_done,
+                             const CopyEngine::DoneCallback &done) {
+  std::atomic<size_t> next = 0;
+  std::atomic<bool> supported = true;
+  std::mutex left_mutex;
+  std::vector<size_t> left;
+  auto worker = [&]() {
+    CopySlot slot;
+    slot.buffer = allocate_buffer();
+    for (size_t i = next++; i < indices.size(); i = next++) {
+      size_t index = indices[i];
+      const FileMove &file = files[index];
+      if (slot.buffer && supported) {
+        if (!open_copy(file, slot)) {
+          done(index, finish_copy(file, slot, false));
+          continue;
+        }
+        if (slot.cloned) {
+          bytes_done += slot.source_stat.st_size;
+          done(index, finish_copy(file, slot, true));
+          continue;
+        }
+        bool unsupported = false;
+        if (copy_in_kernel(slot, bytes_done, unsupported)) {
+          bool checked = !copy_verify_checksum || checksum_both(slot);
+          done(index, finish_copy(file, slot, checked));
+          continue;
+        }
+        // Throws the .part away, the fallback starts from scratch
+        finish_copy(file, slot, false);
+        if (unsupported) {
+          supported = false;
+        }
+      }
+      std::lock_guard<std::mutex> lock(left_mutex);
+      left.push_back(index);
+    }
+    free(slot.buffer);
+  };
+
+  unsigned int thread_count =
+      SDL_min(copy_files_in_flight, static_cast<unsigned int>(indices.size()));
+  std::vector<std::thread> threads;
+  for (unsigned int i = 1; i < thread_count; i++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  indices = std::move(left);
+}
+
+#endif
+
+static void copy_with_threads(const std::vector<FileMove> &files,
+                              const std::vector<size_t> &indices,
+                              std::atomic<uint64_t> &bytes_done,
+                              const CopyEngine::DoneCallback &done) {
+  std::atomic<size_t> next = 0;
+  auto worker = [&]() {
+    CopySlot slot;
+    slot.buffer = allocate_buffer();
+    for (size_t i = next++; i < indices.size(); i = next++) {
+      size_t index = indices[i];
+      bool copied =
+          slot.buffer && copy_blocking(files[index], slot, bytes_done);
+      done(index, copied);
+    }
+    free(slot.buffer);
+  };
+
+  unsigned int thread_count =
+      SDL_min(copy_files_in_flight, static_cast<unsigned int>(indices.size()));
+  std::vector<std::thread> threads;
+  for (unsigned int i = 1; i < thread_count; i++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+}
+
+#ifdef __linux__
+
+// Bare io_uring through the syscalls, one operation in flight per file.
+// Only READV/WRITEV/FSYNC are used, all there since Linux 5.1.
+class Ring {
+public:
+  ~Ring() { destroy(); }
+
+  bool init(unsigned int entries) {
+    io_uring_params params = {};
+    fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0) {
+      return false;
+    }
+
+    sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    sq_ring = mmap(nullptr, sq_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    cq_ring = mmap(nullptr, cq_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe *>(
+        mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+    if (sq_ring == MAP_FAILED || cq_ring == MAP_FAILED || sqes == MAP_FAILED) {
+      destroy();
+      return false;
+    }
+
+    uint8_t *sq = static_cast<uint8_t *>(sq_ring);
+    sq_tail = reinterpret_cast<unsigned int *>(sq + params.sq_off.tail);
+    sq_mask = *reinterpret_cast<unsigned int *>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned int *>(sq + params.sq_off.array);
+    uint8_t *cq = static_cast<uint8_t *>(cq_ring);
+    cq_head = reinterpret_cast<unsigned int *>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned int *>(cq + params.cq_off.tail);
+    cq_mask = *reinterpret_cast<unsigned int *>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    return true;
+  }
+
+  void destroy() {
+    if (sqes && sqes != MAP_FAILED) {
+      munmap(sqes, sqes_size);
+    }
+    if (cq_ring && cq_ring != MAP_FAILED) {
+      munmap(cq_ring, cq_size);
+    }
+    if (sq_ring && sq_ring != MAP_FAILED) {
+      munmap(sq_ring, sq_size);
+    }
+    sqes = nullptr;
+    cq_ring = nullptr;
+    sq_ring = nullptr;
+    if (fd >= 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+
+  // Queued until the next submit_and_wait()
+  void push(uint8_t opcode, int file_fd, const iovec *iov, uint64_t offset,
+            uint64_t user_data) {
+    unsigned int tail = *sq_tail;
+    unsigned int index = tail & sq_mask;
+    io_uring_sqe &sqe = sqes[index];
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = opcode;
+    sqe.fd = file_fd;
+    sqe.addr = reinterpret_cast<uint64_t>(iov);
+    sqe.len = iov ? 1 : 0;
+    sqe.off = offset;
+    sqe.user_data = user_data;
+    sq_array[index] = index;
+    // The kernel may only see the entry once it's filled in
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    queued++;
+  }
+
+  // Submits everything queued and waits for at least one completion. Can
+  // return early without either when the kernel is short on resources.
+  bool submit_and_wait() {
+    int result = static_cast<int>(syscall(__NR_io_uring_enter, fd, queued, 1,
+                                          IORING_ENTER_GETEVENTS, nullptr, 0));
+    if (result >= 0) {
+      queued -= SDL_min(static_cast<unsigned int>(result), queued);
+      return true;
+    }
+    if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+      return true;
+    }
+    SDL_Log("ERROR: io_uring_enter: %s", strerror(errno));
+    return false;
+  }
+
+  bool pop(io_uring_cqe &cqe) {
+    unsigned int head = *cq_head;
+    if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+      return false;
+    }
+    cqe = cqes[head & cq_mask];
+    __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+private:
+  int fd = -1;
+  void *sq_ring = nullptr;
+  void *cq_ring = nullptr;
+  size_t sq_size = 0;
+  size_t cq_size = 0;
+  size_t sqes_size = 0;
+  io_uring_sqe *sqes = nullptr;
+  unsigned int *sq_tail = nullptr;
+  unsigned int sq_mask = 0;
+  unsigned int *sq_array = nullptr;
+  unsigned int *cq_head = nullptr;
+  unsigned int *cq_tail = nullptr;
+  unsigned int cq_mask = 0;
+  io_uring_cqe *cqes = nullptr;
+  unsigned int queued = 0;
+};
+
+static void push_io(Ring &ring, CopySlot &slot, size_t slot_index) {
+  switch (slot.phase) {
+  case CopySlot::READ:
+  case CopySlot::VERIFY:
+    slot.iov.iov_base = slot.buffer + slot.filled;
+    slot.iov.iov_len = slot.chunk_size() - slot.filled;
+    ring.push(IORING_OP_READV,
+              slot.phase == CopySlot::READ ? slot.in_fd : slot.out_fd,
+              &slot.iov, slot.offset + slot.filled, slot_index);
+    break;
+  case CopySlot::WRITE:
+    slot.iov.iov_base = slot.buffer + slot.written;
+    slot.iov.iov_len = slot.filled - slot.written;
+    ring.push(IORING_OP_WRITEV, slot.out_fd, &slot.iov,
+              slot.offset + slot.written, slot_index);
+    break;
+  case CopySlot::SYNC:
+    ring.push(IORING_OP_FSYNC, slot.out_fd, nullptr, 0, slot_index);
+    break;
+  }
+}
+
+enum StepResult {
+  STEP_CONTINUE, // Next operation queued
+  STEP_DONE,
+  STEP_FAILED,
+};
+
+// Advances a file after one of its operations completed
+static StepResult step(Ring &ring, CopySlot &slot, size_t slot_index,
+                       int result, std::atomic<uint64_t> &bytes_done) {
+  if (result == -EINTR || result == -EAGAIN) {
+    push_io(ring, slot, slot_index);
+    return STEP_CONTINUE;
+  }
+  if (result < 0) {
+    SDL_Log("ERROR: copying to %s: %s", slot.part_path.c_str(),
+            strerror(-result));
+    return STEP_FAILED;
+  }
+  uint64_t size = slot.source_stat.st_size;
+  size_t length = static_cast<size_t>(result);
+
+  switch (slot.phase) {
+  case CopySlot::READ:
+  case CopySlot::VERIFY:
+    if (result == 0) {
+      return STEP_FAILED; // Shorter than it was when opened
+    }
+    slot.filled += length;
+    if (slot.filled < slot.chunk_size()) {
+      break;
+    }
+    if (slot.phase == CopySlot::VERIFY) {
+      slot.copy_checksum =
+          checksum(slot.copy_checksum, slot.buffer, slot.filled);
+      slot.offset += slot.filled;
+      slot.filled = 0;
+      if (slot.offset == size) {
+        return STEP_DONE;
+      }
+      break;
+    }
+    slot.source_checksum =
+        checksum(slot.source_checksum, slot.buffer, slot.filled);
+    slot.phase = CopySlot::WRITE;
+    slot.written = 0;
+    break;
+  case CopySlot::WRITE:
+    slot.written += length;
+    if (slot.written < slot.filled) {
+      break;
+    }
+    bytes_done += slot.filled;
+    slot.offset += slot.filled;
+    slot.filled = 0;
+    if (slot.offset == size) {
+      if (!copy_verify_checksum) {
+        return STEP_DONE;
+      }
+      slot.phase = CopySlot::SYNC;
+    } else {
+      slot.phase = CopySlot::READ;
+    }
+    break;
+  case CopySlot::SYNC:
+    drop_cached(slot.out_fd);
+    slot.phase = CopySlot::VERIFY;
+    slot.offset = 0;
+    break;
+  }
+  push_io(ring, slot, slot_index);
+  return STEP_CONTINUE;
+}
+
+// false if the ring couldn't be used at all, the caller then falls back to
+// threads for whatever is left in indices
+static bool copy_with_io_uring(const std::vector<FileMove> &files,
+                               std::vector<size_t> &indices,
+                               std::atomic<uint64_t> &bytes_done,
+                               const CopyEngine::DoneCallback &done) {
+  size_t slot_count =
+      SDL_min(size_t(copy_files_in_flight), SDL_max(indices.size(), size_t(1)));
+  Ring ring;
+  if (!ring.init(static_cast<unsigned int>(slot_count))) {
+    SDL_Log("io_uring unavailable (%s), copying with threads",
+            strerror(errno));
+    return false;
+  }
+
+  std::vector<CopySlot> slots(slot_count);
+  std::vector<size_t> free_slots;
+  for (size_t i = 0; i < slot_count; i++) {
+    slots[i].buffer = allocate_buffer();
+    if (!slots[i].buffer) {
+      for (CopySlot &slot : slots) {
+        free(slot.buffer);
+      }
+      return false;
+    }
+    free_slots.push_back(slot_count - 1 - i);
+  }
+
+  size_t next = 0;
+  size_t active = 0;
+  bool ring_failed = false;
+  while (!ring_failed && (next < indices.size() || active > 0)) {
+    // Start new files in the free slots, tiny and cloned ones finish here
+    while (!free_slots.empty() && next < indices.size()) {
+      size_t slot_index = free_slots.back();
+      CopySlot &slot = slots[slot_index];
+      slot.index = indices[next++];
+      const FileMove &file = files[slot.index];
+      if (!open_copy(file, slot)) {
+        done(slot.index, finish_copy(file, slot, false));
+        continue;
+      }
+      if (slot.cloned || slot.source_stat.st_size == 0) {
+        bytes_done += slot.source_stat.st_size;
+        done(slot.index, finish_copy(file, slot, true));
+        continue;
+      }
+      free_slots.pop_back();
+      push_io(ring, slot, slot_index);
+      active++;
+    }
+    if (active == 0) {
+      continue;
+    }
+
+    if (!ring.submit_and_wait()) {
+      ring_failed = true;
+      break;
+    }
+    io_uring_cqe cqe;
+    while (ring.pop(cqe)) {
+      size_t slot_index = static_cast<size_t>(cqe.user_data);
+      CopySlot &slot = slots[slot_index];
+      StepResult result = step(ring, slot, slot_index, cqe.res, bytes_done);
+      if (result == STEP_CONTINUE) {
+        continue;
+      }
+      bool copied = finish_copy(files[slot.index], slot, result == STEP_DONE);
+      done(slot.index, copied);
+      free_slots.push_back(slot_index);
+      active--;
+    }
+  }
+
+  if (!ring_failed) {
+    for (CopySlot &slot : slots) {
+      free(slot.buffer);
+    }
+    indices.clear();
+    return true;
+  }
+
+  // Hand unfinished files back to the threads. Operations still in flight
+  // may touch the buffers until the kernel has torn the ring down, so those
+  // are leaked rather than freed.
+  std::vector<size_t> unfinished;
+  for (CopySlot &slot : slots) {
+    if (slot.in_fd >= 0) {
+      // The threads copy it again from the start
+      bool all_written =
+          slot.phase == CopySlot::SYNC || slot.phase == CopySlot::VERIFY;
+      bytes_done -= all_written ? uint64_t(slot.source_stat.st_size)
+                                : slot.offset;
+      finish_copy(files[slot.index], slot, false);
+      unfinished.push_back(slot.index);
+    }
+  }
+  unfinished.insert(unfinished.end(), indices.begin() + next, indices.end());
+  indices = std::move(unfinished);
+  return false;
+}
+
+#endif
+
+CopyEngine::Stats CopyEngine::copy_files(const std::vector<FileMove> &files,
+                                         std::atomic<uint64_t> &bytes_done,
+                                         const DoneCallback &done) {
+  auto start_time = std::chrono::steady_clock::now();
+  uint64_t start_bytes = bytes_done;
+  std::vector<size_t> indices(files.size());
+  for (size_t i = 0; i < files.size(); i++) {
+    indices[i] = i;
+  }
+
+  Stats stats;
+  stats.backend = "threads";
+#ifdef __linux__
+  copy_with_kernel(files, indices, bytes_done, done);
+  if (indices.empty()) {
+    stats.backend = "copy_file_range";
+  } else if (copy_with_io_uring(files, indices, bytes_done, done)) {
+    stats.backend = "io_uring";
+  }
+#endif
+  if (!indices.empty()) {
+    copy_with_threads(files, indices, bytes_done, done);
+  }
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start_time;
+  stats.bytes = bytes_done - start_bytes;
+  stats.seconds = elapsed.count();
+  return stats;
+}
+
+bool CopyEngine::rename_no_replace(const std::filesystem::path &from,
+                                   const std::filesystem::path &to,
+                                   std::error_code &error) {
+  error.clear();
+#ifdef __linux__
+  if (renameat2(AT_FDCWD, from.c_str(), AT_FDCWD, to.c_str(),
+                RENAME_NOREPLACE) == 0) {
+    return true;
+  }
+  if (errno != EINVAL && errno != ENOSYS) {
+    error = std::error_code(errno, std::generic_category());
+    return false;
+  }
+#endif
+  // No RENAME_NOREPLACE on this filesystem, a hard link can't replace either
+  if (link(from.c_str(), to.c_str()) == 0) {
+    unlink(from.c_str());
+    return true;
+  }
+  if (errno == EEXIST || errno == EXDEV || errno == ENOENT) {
+    error = std::error_code(errno, std::generic_category());
+    return false;
+  }
+  // Nor hard links (FAT, exFAT), check first and hope nothing races us
+  if (std::filesystem::exists(to, error) || error) {
+    if (!error) {
+      error = std::make_error_code(std::errc::file_exists);
+    }
+    return false;
+  }
+  std::filesystem::rename(from, to, error);
+  return !error;
+}
+
+#endif
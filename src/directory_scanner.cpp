@@ -0,0 +1,207 @@
+#include "directory_scanner.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <string>
+#include <unordered_map>
+
+#include "SDL3/SDL_log.h"
+
+#include "config.hpp"
+#include "raw_preview.hpp"
+
+static const char *jpeg_extensions[] = {".jpg", ".jpeg", ".jpe"};
+
+static bool is_jpeg(const std::filesystem::path &path) {
+  std::string extension = path.extension().string();
+  for (char &c : extension) {
+    c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  }
+  for (const char *jpeg_extension : jpeg_extensions) {
+    if (extension == jpeg_extension) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool DirectoryScanner::is_photo_file(const std::filesystem::path &path) {
+  return is_jpeg(path) || RawPreview::is_raw(path);
+}
+
+// Three digits from 100 then five free characters
+bool DirectoryScanner::is_dcf_folder(const std::filesystem::path &path) {
+  std::string name = path.filename().string();
+  if (name.size() != 8 || name[0] < '1' || name[0] > '9') {
+    return false;
+  }
+  for (size_t i = 0; i < name.size(); i++) {
+    unsigned char c = static_cast<unsigned char>(name[i]);
+    if (i < 3 ? !std::isdigit(c) : !(std::isalnum(c) || c == '_')) {
+      return false;
+    }
+  }
+  return true;
+}
+
+DirectoryScanner::~DirectoryScanner() { cancel(); }
+
+void DirectoryScanner::start(const std::filesystem::path &folder) {
+  cancel();
+  cancelled = false;
+  scanning = true;
+  thread = std::thread(&DirectoryScanner::scan_main, this, folder);
+}
+
+void DirectoryScanner::cancel() {
+  cancelled = true;
+  if (thread.joinable()) {
+    thread.join();
+  }
+  std::lock_guard<std::mutex> lock(found_mutex);
+  found.clear();
+}
+
+bool DirectoryScanner::poll(std::vector<ScannedPhoto> &photos) {
+  std::lock_guard<std::mutex> lock(found_mutex);
+  if (found.empty()) {
+    return false;
+  }
+  for (ScannedPhoto &photo : found) {
+    photos.push_back(std::move(photo));
+  }
+  found.clear();
+  return true;
+}
+
+void DirectoryScanner::publish(std::vector<ScannedPhoto> &batch) {
+  if (batch.empty()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(found_mutex);
+  for (ScannedPhoto &photo : batch) {
+    found.push_back(std::move(photo));
+  }
+  batch.clear();
+}
+
+// Memory card layouts, opened at the card root or at DCIM
+static std::vector<std::filesystem::path>
+dcf_subfolders(const std::filesystem::path &folder) {
+  std::error_code error;
+  std::filesystem::path dcim = folder / "DCIM";
+  if (folder.filename() == "DCIM" ||
+      !std::filesystem::is_directory(dcim, error)) {
+    dcim = folder;
+  }
+  std::vector<std::filesystem::path> subfolders;
+  for (std::filesystem::directory_iterator it(dcim, error), end;
+       !error && it != end; it.increment(error)) {
+    if (it->is_directory(error) &&
+        DirectoryScanner::is_dcf_folder(it->path())) {
+      subfolders.push_back(it->path());
+    }
+  }
+  std::sort(subfolders.begin(), subfolders.end());
+  return subfolders;
+}
+
+std::vector<std::filesystem::path>
+DirectoryScanner::photo_folders(const std::filesystem::path &folder) {
+  std::vector<std::filesystem::path> folders = dcf_subfolders(folder);
+  folders.insert(folders.begin(), folder);
+  return folders;
+}
+
+void DirectoryScanner::scan_main(std::filesystem::path folder) {
+  auto start_time = std::chrono::steady_clock::now();
+  // The folder itself first, so its photos show up before the subfolders
+  // have been listed
+  scan_folder(folder);
+  for (const std::filesystem::path &subfolder : dcf_subfolders(folder)) {
+    if (cancelled) {
+      break;
+    }
+    scan_folder(subfolder);
+  }
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start_time;
+  SDL_Log("Scanned %s in %.2fs", folder.c_str(), elapsed.count());
+  scanning = false;
+}
+
+// Directory order usually keeps a pair's files next to each other, so raws
+// are held back for a few entries waiting for their JPEG. Pairs that are
+// further apart still get matched up when the grid adds them.
+void DirectoryScanner::scan_folder(const std::filesystem::path &folder) {
+  const size_t raw_hold_entries = 64;
+  struct HeldRaw {
+    std::filesystem::path path;
+    size_t seen_at;
+  };
+
+  std::vector<ScannedPhoto> batch;
+  std::vector<HeldRaw> held_raws;
+  std::unordered_map<std::string, size_t> batch_jpegs; // Stem -> batch index
+  size_t entry_count = 0;
+  auto last_publish = std::chrono::steady_clock::now();
+
+  std::error_code error;
+  for (std::filesystem::directory_iterator it(folder, error), end;
+       !error && it != end && !cancelled; it.increment(error)) {
+    entry_count++;
+    // Uses the type readdir already returned where the OS has it
+    if (!it->is_regular_file(error)) {
+      continue;
+    }
+    const std::filesystem::path &path = it->path();
+    std::string stem = path.stem().string();
+
+    if (is_jpeg(path)) {
+      ScannedPhoto photo{.file_path = path};
+      for (auto held = held_raws.begin(); held != held_raws.end(); ++held) {
+        if (held->path.stem() == path.stem()) {
+          photo.pair_path = std::move(held->path);
+          held_raws.erase(held);
+          break;
+        }
+      }
+      if (photo.pair_path.empty()) {
+        batch_jpegs[stem] = batch.size();
+      }
+      batch.push_back(std::move(photo));
+    } else if (RawPreview::is_raw(path)) {
+      auto jpeg = batch_jpegs.find(stem);
+      if (jpeg != batch_jpegs.end()) {
+        batch[jpeg->second].pair_path = path;
+        batch_jpegs.erase(jpeg);
+      } else {
+        held_raws.push_back(HeldRaw{.path = path, .seen_at = entry_count});
+      }
+    }
+
+    while (!held_raws.empty() &&
+           entry_count - held_raws.front().seen_at > raw_hold_entries) {
+      batch.push_back(ScannedPhoto{.file_path = held_raws.front().path});
+      held_raws.erase(held_raws.begin());
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (batch.size() >= scan_batch_size ||
+        now - last_publish > std::chrono::milliseconds(100)) {
+      publish(batch);
+      batch_jpegs.clear();
+      last_publish = now;
+    }
+  }
+  if (error) {
+    SDL_Log("Failed to list %s: %s", folder.c_str(), error.message().c_str());
+  }
+
+  for (HeldRaw &held : held_raws) {
+    batch.push_back(ScannedPhoto{.file_path = std::move(held.path)});
+  }
+  publish(batch);
+}
@@ -0,0 +1,121 @@
+#include "exif.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "tiff.hpp"
+
+namespace Exif {
+
+static void add_preview(size_t offset, size_t length, size_t file_size,
+                        std::vector<EmbeddedImage> &previews) {
+  if (length == 0 || offset >= file_size || length > file_size - offset) {
+    return;
+  }
+  previews.push_back(EmbeddedImage{.offset = offset, .length = length});
+}
+
+// APP1 "Exif\0\0", the thumbnail lives in IFD1
+static void parse_exif(const uint8_t *segment, size_t segment_size,
+                       size_t segment_offset, size_t file_size,
+                       std::vector<EmbeddedImage> &previews) {
+  if (segment_size < 6 || memcmp(segment, "Exif\0\0", 6) != 0) {
+    return;
+  }
+  TiffReader tiff{.base = segment + 6, .size = segment_size - 6};
+  uint32_t ifd0;
+  uint32_t ifd1;
+  if (!tiff.header(ifd0) || !tiff.next_ifd(ifd0, ifd1) || ifd1 == 0) {
+    return;
+  }
+  uint32_t thumbnail_offset;
+  uint32_t thumbnail_length;
+  if (tiff.find_tag(ifd1, TiffTag::JPEG_INTERCHANGE_FORMAT,
+                    thumbnail_offset) &&
+      tiff.find_tag(ifd1, TiffTag::JPEG_INTERCHANGE_FORMAT_LENGTH,
+                    thumbnail_length)) {
+    add_preview(segment_offset + 6 + thumbnail_offset, thumbnail_length,
+                file_size, previews);
+  }
+}
+
+// APP2 "MPF\0", CIPA DC-007 multi picture format. Entry 0 is the primary
+// image itself, the rest are (usually larger) previews.
+static void parse_mpf(const uint8_t *segment, size_t segment_size,
+                      size_t segment_offset, size_t file_size,
+                      std::vector<EmbeddedImage> &previews) {
+  if (segment_size < 4 || memcmp(segment, "MPF\0", 4) != 0) {
+    return;
+  }
+  size_t mp_header_offset = segment_offset + 4;
+  TiffReader tiff{.base = segment + 4, .size = segment_size - 4};
+  uint32_t index_ifd;
+  uint32_t entries_offset;
+  uint32_t entries_size;
+  if (!tiff.header(index_ifd) ||
+      !tiff.find_tag(index_ifd, TiffTag::MP_ENTRY, entries_offset,
+                     &entries_size)) {
+    return;
+  }
+  for (uint32_t entry = 16; entry + 16 <= entries_size; entry += 16) {
+    uint32_t image_size;
+    uint32_t image_offset;
+    if (!tiff.u32(entries_offset + entry + 4, image_size) ||
+        !tiff.u32(entries_offset + entry + 8, image_offset) ||
+        image_offset == 0) {
+      continue;
+    }
+    add_preview(mp_header_offset + image_offset, image_size, file_size,
+                previews);
+  }
+}
+
+bool find_previews(const uint8_t *data, size_t size, size_t file_size,
+                   std::vector<EmbeddedImage> &previews) {
+  previews.clear();
+  if (size < 4 || data[0] != 0xFF || data[1] != 0xD8) {
+    return false;
+  }
+
+  size_t offset = 2;
+  while (offset + 4 <= size) {
+    if (data[offset] != 0xFF) {
+      break;
+    }
+    uint8_t marker = data[offset + 1];
+    // Fill bytes
+    if (marker == 0xFF) {
+      offset++;
+      continue;
+    }
+    // Start of scan, no more metadata after this
+    if (marker == 0xDA || marker == 0xD9) {
+      break;
+    }
+    size_t segment_size = data[offset + 2] << 8 | data[offset + 3];
+    if (segment_size < 2) {
+      break;
+    }
+    size_t payload_offset = offset + 4;
+    size_t payload_size = segment_size - 2;
+    if (payload_offset + payload_size > size) {
+      break;
+    }
+    if (marker == 0xE1) {
+      parse_exif(data + payload_offset, payload_size, payload_offset, file_size,
+                 previews);
+    } else if (marker == 0xE2) {
+      parse_mpf(data + payload_offset, payload_size, payload_offset, file_size,
+                previews);
+    }
+    offset = payload_offset + payload_size;
+  }
+
+  std::sort(previews.begin(), previews.end(),
+            [](const EmbeddedImage &a, const EmbeddedImage &b) {
+              return a.length < b.length;
+            });
+  return !previews.empty();
+}
+
+} // namespace Exif
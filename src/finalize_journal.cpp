@@ -0,0 +1,214 @@
+#include "finalize_journal.hpp"
+
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include "SDL3/SDL_log.h"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const char JOURNAL_MAGIC[8] = {'S', 'R', 'M', 'O', 'V', 'E', 'S', '1'};
+
+// Longest path a move record can hold, anything longer is a torn or corrupt
+// length field
+#ifdef PATH_MAX
+static const uint32_t MAX_RECORD_PATH = PATH_MAX;
+#else
+static const uint32_t MAX_RECORD_PATH = 32767;
+#endif
+
+enum RecordType : uint32_t {
+  RECORD_MOVE,
+  RECORD_DONE,
+};
+
+// Fixed part of a journal record, a move is followed by from_length bytes of
+// source path and to_length bytes of destination path
+struct JournalRecord {
+  uint32_t type;
+  uint32_t index;
+  uint32_t from_length;
+  uint32_t to_length;
+};
+
+static bool sync_file(FILE *file) {
+  if (fflush(file) != 0) {
+    return false;
+  }
+#ifdef _WIN32
+  return _commit(_fileno(file)) == 0;
+#else
+  return fsync(fileno(file)) == 0;
+#endif
+}
+
+// Makes a rename inside folder durable
+static void sync_folder(const std::filesystem::path &folder) {
+#ifndef _WIN32
+  int fd = open(folder.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd >= 0) {
+    fsync(fd);
+    close(fd);
+  }
+#endif
+}
+
+FinalizeJournal::~FinalizeJournal() {
+  if (file) {
+    fclose(file);
+  }
+}
+
+std::filesystem::path
+FinalizeJournal::path_for(const std::filesystem::path &folder) {
+  return folder / ".finalize.journal";
+}
+
+bool FinalizeJournal::create(const std::filesystem::path &path,
+                             const std::vector<FileMove> &moves) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (file) {
+    fclose(file);
+  }
+  this->path = path;
+
+  // Written next to the journal and renamed over it, so replacing the
+  // journal of a resumed batch never leaves a half written one behind
+  std::filesystem::path temporary_path = path;
+  temporary_path += ".tmp";
+  file = fopen(temporary_path.string().c_str(), "wb");
+  if (!file) {
+    SDL_Log("ERROR: creating finalize journal %s: %s",
+            temporary_path.string().c_str(), strerror(errno));
+    return false;
+  }
+
+  bool written = fwrite(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC), 1, file) == 1;
+  for (size_t i = 0; i < moves.size() && written; i++) {
+    std::string from = moves[i].from.string();
+    std::string to = moves[i].to.string();
+    JournalRecord record = {
+        .type = RECORD_MOVE,
+        .index = static_cast<uint32_t>(i),
+        .from_length = static_cast<uint32_t>(from.size()),
+        .to_length = static_cast<uint32_t>(to.size()),
+    };
+    written = fwrite(&record, sizeof(record), 1, file) == 1 &&
+              fwrite(from.data(), 1, from.size(), file) == from.size() &&
+              fwrite(to.data(), 1, to.size(), file) == to.size();
+  }
+  std::error_code error;
+  if (written && sync_file(file)) {
+    std::filesystem::rename(temporary_path, path, error);
+  }
+  if (!written || error) {
+    SDL_Log("ERROR: writing finalize journal %s", path.string().c_str());
+    fclose(file);
+    file = nullptr;
+    std::filesystem::remove(temporary_path, error);
+    return false;
+  }
+  sync_folder(path.parent_path());
+  return true;
+}
+
+void FinalizeJournal::mark_done(size_t index) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!file) {
+    return;
+  }
+  // Not synced, a lost done record only means the move gets checked again
+  JournalRecord record = {
+      .type = RECORD_DONE,
+      .index = static_cast<uint32_t>(index),
+  };
+  fwrite(&record, sizeof(record), 1, file);
+  fflush(file);
+}
+
+void FinalizeJournal::close() {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!file) {
+    return;
+  }
+  // Done records aren't synced as they go, make them stick so the next run
+  // only retries what is actually outstanding
+  sync_file(file);
+  fclose(file);
+  file = nullptr;
+}
+
+void FinalizeJournal::finish() {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!file) {
+    return;
+  }
+  fclose(file);
+  file = nullptr;
+  std::error_code error;
+  std::filesystem::remove(path, error);
+}
+
+bool FinalizeJournal::read_pending(const std::filesystem::path &path,
+                                   std::vector<FileMove> &pending) {
+  std::error_code error;
+  uintmax_t file_size = std::filesystem::file_size(path, error);
+  if (error) {
+    return false;
+  }
+  std::ifstream in(path, std::ios::binary);
+  char magic[sizeof(JOURNAL_MAGIC)];
+  if (!in.read(magic, sizeof(magic)) ||
+      memcmp(magic, JOURNAL_MAGIC, sizeof(magic)) != 0) {
+    return false;
+  }
+
+  // A torn record at the end (crash mid-write) is simply ignored, along with
+  // anything after it
+  std::vector<FileMove> moves;
+  std::vector<bool> done;
+  JournalRecord record;
+  std::string from;
+  std::string to;
+  while (in.read(reinterpret_cast<char *>(&record), sizeof(record))) {
+    if (record.type == RECORD_DONE) {
+      if (record.index < done.size()) {
+        done[record.index] = true;
+      }
+      continue;
+    }
+    // Lengths are checked before allocating, a garbage length in a torn
+    // tail would otherwise ask for gigabytes
+    uint64_t position = static_cast<uint64_t>(in.tellg());
+    uint64_t remaining = position < file_size ? file_size - position : 0;
+    if (record.type != RECORD_MOVE || record.index != moves.size() ||
+        record.from_length > MAX_RECORD_PATH ||
+        record.to_length > MAX_RECORD_PATH ||
+        uint64_t{record.from_length} + record.to_length > remaining) {
+      break;
+    }
+    from.resize(record.from_length);
+    to.resize(record.to_length);
+    if (!in.read(from.data(), from.size()) || !in.read(to.data(), to.size())) {
+      break;
+    }
+    moves.push_back({from, to});
+    done.push_back(false);
+  }
+
+  for (size_t i = 0; i < moves.size(); i++) {
+    if (!done[i]) {
+      pending.push_back(std::move(moves[i]));
+    }
+  }
+  return true;
+}
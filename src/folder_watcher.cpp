@@ -0,0 +1,139 @@
+#include "folder_watcher.hpp"
+
+#include "SDL3/SDL_log.h"
+
+#include "directory_scanner.hpp"
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+FolderWatcher::~FolderWatcher() { stop(); }
+
+#ifdef __linux__
+
+// Only finished writes count, a copy in progress shows up once it's closed
+static const uint32_t photo_folder_mask =
+    IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM | IN_CREATE;
+
+bool FolderWatcher::watch(const std::filesystem::path &folder) {
+  stop();
+  fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0) {
+    SDL_Log("WARNING: inotify_init1 failed: %s", strerror(errno));
+    return false;
+  }
+  read_buffer.resize(64 * 1024);
+
+  std::vector<std::filesystem::path> folders =
+      DirectoryScanner::photo_folders(folder);
+  for (const std::filesystem::path &photo_folder : folders) {
+    add_watch(photo_folder, true);
+  }
+  // New card folders get created under DCIM
+  std::error_code error;
+  std::filesystem::path dcim = folder / "DCIM";
+  if (folder.filename() != "DCIM" &&
+      std::filesystem::is_directory(dcim, error)) {
+    add_watch(dcim, false);
+  }
+  return true;
+}
+
+void FolderWatcher::add_watch(const std::filesystem::path &path,
+                              bool photos) {
+  uint32_t mask = photos ? photo_folder_mask : IN_CREATE | IN_MOVED_TO;
+  int wd = inotify_add_watch(fd, path.c_str(), mask);
+  if (wd < 0) {
+    SDL_Log("WARNING: watching %s: %s", path.c_str(), strerror(errno));
+    return;
+  }
+  // Watching the same folder twice hands back the same descriptor
+  Watch &watch = watches[wd];
+  watch.path = path;
+  watch.photos = watch.photos || photos;
+}
+
+void FolderWatcher::stop() {
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+  watches.clear();
+}
+
+bool FolderWatcher::poll(std::vector<FolderEvent> &events) {
+  if (fd < 0) {
+    return false;
+  }
+  size_t event_count = events.size();
+  while (true) {
+    ssize_t length = read(fd, read_buffer.data(), read_buffer.size());
+    if (length <= 0) {
+      if (length < 0 && errno != EAGAIN && errno != EINTR) {
+        SDL_Log("WARNING: reading inotify events: %s", strerror(errno));
+      }
+      break;
+    }
+
+    for (ssize_t offset = 0; offset < length;) {
+      const inotify_event *event =
+          reinterpret_cast<const inotify_event *>(read_buffer.data() + offset);
+      offset += sizeof(inotify_event) + event->len;
+
+      if (event->mask & IN_Q_OVERFLOW) {
+        events.push_back({FolderEvent::RESCAN, {}});
+        continue;
+      }
+      if (event->mask & IN_IGNORED) {
+        watches.erase(event->wd);
+        continue;
+      }
+      auto watch = watches.find(event->wd);
+      if (watch == watches.end() || event->len == 0) {
+        continue;
+      }
+      std::filesystem::path path = watch->second.path / event->name;
+
+      if (event->mask & IN_ISDIR) {
+        if ((event->mask & (IN_CREATE | IN_MOVED_TO)) &&
+            DirectoryScanner::is_dcf_folder(path)) {
+          add_watch(path, true);
+          // Anything that landed before the watch did won't get an event
+          std::error_code error;
+          for (std::filesystem::directory_iterator it(path, error), end;
+               !error && it != end; it.increment(error)) {
+            if (DirectoryScanner::is_photo_file(it->path())) {
+              events.push_back({FolderEvent::FILE_WRITTEN, it->path()});
+            }
+          }
+        }
+        continue;
+      }
+      if (!watch->second.photos || !DirectoryScanner::is_photo_file(path)) {
+        continue;
+      }
+      if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+        events.push_back({FolderEvent::FILE_WRITTEN, std::move(path)});
+      } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+        events.push_back({FolderEvent::FILE_REMOVED, std::move(path)});
+      }
+    }
+  }
+  return events.size() > event_count;
+}
+
+#else
+
+bool FolderWatcher::watch(const std::filesystem::path &folder) {
+  return false;
+}
+
+void FolderWatcher::stop() {}
+
+bool FolderWatcher::poll(std::vector<FolderEvent> &events) { return false; }
+
+#endif
@@ -0,0 +1,328 @@
+#include "glyph_atlas.hpp"
+
+#include <cmath>
+#include <cstring>
+
+#include "SDL3/SDL_log.h"
+
+#include "config.hpp"
+
+static uint64_t glyph_key(uint16_t font_id, int bucket, uint32_t codepoint) {
+  return (uint64_t(font_id) << 48) | (uint64_t(bucket) << 32) | codepoint;
+}
+
+GlyphAtlas::~GlyphAtlas() { cleanup(); }
+
+bool GlyphAtlas::init(SDL_GPUDevice *device,
+                      const std::vector<std::string> &font_paths) {
+  this->device = device;
+  this->font_paths = font_paths;
+  size = glyph_atlas_size;
+  pixels.assign(size_t(size) * size, 0);
+
+  SDL_GPUTextureCreateInfo texture_info{};
+  texture_info.type = SDL_GPU_TEXTURETYPE_2D;
+  texture_info.format = SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM;
+  texture_info.usage = SDL_GPU_TEXTUREUSAGE_SAMPLER;
+  texture_info.width = size;
+  texture_info.height = size;
+  texture_info.layer_count_or_depth = 1;
+  texture_info.num_levels = 1;
+  texture = SDL_CreateGPUTexture(device, &texture_info);
+
+  // Big enough for every shelf being dirty at once
+  SDL_GPUTransferBufferCreateInfo transfer_info{};
+  transfer_info.usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD;
+  transfer_info.size = size * size * 4;
+  transfer_buffer = SDL_CreateGPUTransferBuffer(device, &transfer_info);
+
+  if (!texture || !transfer_buffer) {
+    SDL_Log("Failed to create glyph atlas: %s", SDL_GetError());
+    return false;
+  }
+
+  // Distance fields only come in one size, so printable ASCII can be ready
+  // before the first frame. It gets uploaded with the first flush.
+  if (glyph_sdf) {
+    int bucket = size_bucket(0.0f);
+    for (uint16_t font_id = 0; font_id < font_paths.size(); font_id++) {
+      for (uint32_t codepoint = 32; codepoint < 127; codepoint++) {
+        find(font_id, bucket, codepoint);
+      }
+    }
+  }
+  return true;
+}
+
+void GlyphAtlas::cleanup() {
+  for (auto &[key, font] : fonts) {
+    if (font.font) {
+      TTF_CloseFont(font.font);
+    }
+  }
+  fonts.clear();
+  glyphs.clear();
+  shelves.clear();
+  if (texture) {
+    SDL_ReleaseGPUTexture(device, texture);
+    texture = nullptr;
+  }
+  if (transfer_buffer) {
+    SDL_ReleaseGPUTransferBuffer(device, transfer_buffer);
+    transfer_buffer = nullptr;
+  }
+}
+
+void GlyphAtlas::begin_frame() {
+  frame++;
+  full_logged = false;
+}
+
+int GlyphAtlas::size_bucket(float pixel_size) {
+  if (glyph_sdf) {
+    return glyph_sdf_pixel_size;
+  }
+  int pixels = SDL_clamp(static_cast<int>(std::ceil(pixel_size)), 6,
+                         glyph_max_pixel_size);
+  // Finer steps for small text, where a pixel more or less shows
+  int power = 1;
+  while (power * 2 <= pixels) {
+    power *= 2;
+  }
+  int step = SDL_max(power / 4, 2);
+  return (pixels + step - 1) / step * step;
+}
+
+GlyphAtlas::SizedFont *GlyphAtlas::find_font(uint16_t font_id, int bucket) {
+  uint32_t key = (uint32_t(font_id) << 16) | uint32_t(bucket);
+  auto it = fonts.find(key);
+  if (it == fonts.end()) {
+    // Failures get remembered too, so they're only logged once
+    SizedFont sized = {};
+    if (font_id < font_paths.size()) {
+      sized.font = TTF_OpenFont(font_paths[font_id].c_str(), bucket);
+    }
+    if (sized.font && glyph_sdf && !TTF_SetFontSDF(sized.font, true)) {
+      SDL_Log("WARNING: font %u can't render distance fields", font_id);
+    }
+    if (sized.font) {
+      sized.metrics.ascent = static_cast<float>(TTF_GetFontAscent(sized.font));
+      sized.metrics.height = static_cast<float>(TTF_GetFontHeight(sized.font));
+    } else {
+      SDL_Log("Failed to load font %u at %d px", font_id, bucket);
+    }
+    it = fonts.emplace(key, sized).first;
+  }
+  return it->second.font ? &it->second : nullptr;
+}
+
+bool GlyphAtlas::line_metrics(uint16_t font_id, int bucket,
+                              LineMetrics &metrics) {
+  SizedFont *font = find_font(font_id, bucket);
+  if (!font) {
+    return false;
+  }
+  metrics = font->metrics;
+  return true;
+}
+
+void GlyphAtlas::clear_shelf(Shelf &shelf) {
+  for (uint64_t key : shelf.glyphs) {
+    glyphs.erase(key);
+  }
+  shelf.glyphs.clear();
+  shelf.x = 0;
+}
+
+// Returns the shelf with room for a width x height glyph at column x, or -1
+int GlyphAtlas::allocate(int width, int height, int &x) {
+  if (width > size) {
+    return -1;
+  }
+  // Shelves come in multiples of 8 tall so similar sizes can share them
+  int shelf_height = (height + 7) / 8 * 8;
+  for (size_t i = 0; i < shelves.size(); i++) {
+    Shelf &shelf = shelves[i];
+    if (shelf.height == shelf_height && shelf.x + width <= size) {
+      x = shelf.x;
+      shelf.x += width;
+      shelf.last_used_frame = frame;
+      return static_cast<int>(i);
+    }
+  }
+
+  int index;
+  int next_y = shelves.empty() ? 0 : shelves.back().y + shelves.back().height;
+  if (next_y + shelf_height <= size) {
+    Shelf shelf = {};
+    shelf.y = next_y;
+    shelf.height = shelf_height;
+    shelf.dirty_begin = size;
+    shelves.push_back(shelf);
+    index = static_cast<int>(shelves.size() - 1);
+  } else {
+    // Full, reuse the least recently drawn shelf that is tall enough
+    index = -1;
+    for (size_t i = 0; i < shelves.size(); i++) {
+      const Shelf &shelf = shelves[i];
+      if (shelf.height >= shelf_height && shelf.last_used_frame < frame &&
+          (index < 0 ||
+           shelf.last_used_frame < shelves[index].last_used_frame)) {
+        index = static_cast<int>(i);
+      }
+    }
+    if (index < 0) {
+      return -1;
+    }
+    clear_shelf(shelves[index]);
+  }
+  Shelf &shelf = shelves[index];
+  x = 0;
+  shelf.x = width;
+  shelf.last_used_frame = frame;
+  return index;
+}
+
+bool GlyphAtlas::rasterize(SizedFont &font, uint32_t codepoint,
+                           Glyph &glyph) {
+  int min_x, max_x, min_y, max_y, advance;
+  if (!TTF_GetGlyphMetrics(font.font, codepoint, &min_x, &max_x, &min_y,
+                           &max_y, &advance)) {
+    return false;
+  }
+  glyph = {};
+  glyph.advance = static_cast<float>(advance);
+  glyph.shelf = -1;
+
+  TTF_ImageType image_type;
+  SDL_Surface *image = TTF_GetGlyphImage(font.font, codepoint, &image_type);
+  if (!image || image->w == 0 || image->h == 0) {
+    // Nothing to draw, only the advance matters
+    if (image) {
+      SDL_DestroySurface(image);
+    }
+    return true;
+  }
+  SDL_Surface *converted = SDL_ConvertSurface(image, SDL_PIXELFORMAT_ABGR8888);
+  SDL_DestroySurface(image);
+  if (!converted) {
+    return false;
+  }
+
+  // A pixel of padding on each side so filtering doesn't bleed in neighbours
+  int width = converted->w;
+  int height = converted->h;
+  int x;
+  int shelf_index = allocate(width + 2, height + 2, x);
+  if (shelf_index < 0) {
+    SDL_DestroySurface(converted);
+    if (!full_logged) {
+      SDL_Log("WARNING: glyph atlas is full of glyphs drawn this frame");
+      full_logged = true;
+    }
+    return false;
+  }
+  Shelf &shelf = shelves[shelf_index];
+  for (int row = 0; row < height + 2; row++) {
+    memset(&pixels[size_t(shelf.y + row) * size + x], 0,
+           size_t(width + 2) * 4);
+  }
+  for (int row = 0; row < height; row++) {
+    memcpy(&pixels[size_t(shelf.y + 1 + row) * size + x + 1],
+           static_cast<const uint8_t *>(converted->pixels) +
+               size_t(row) * converted->pitch,
+           size_t(width) * 4);
+  }
+  SDL_DestroySurface(converted);
+  shelf.dirty_begin = SDL_min(shelf.dirty_begin, x);
+  shelf.dirty_end = SDL_max(shelf.dirty_end, x + width + 2);
+
+  // Same placement the glyph image has relative to the baseline. Distance
+  // field images have the spread added around the outline on every side.
+  float padding_x = (width - (max_x - min_x)) * 0.5f;
+  float padding_y = (height - (max_y - min_y)) * 0.5f;
+  glyph.offset = glm::vec2(min_x - padding_x,
+                           font.metrics.ascent - max_y - padding_y);
+  glyph.size = glm::vec2(width, height);
+  float scale = 1.0f / size;
+  glyph.uv_rect = glm::vec4((x + 1) * scale, (shelf.y + 1) * scale,
+                            (x + 1 + width) * scale,
+                            (shelf.y + 1 + height) * scale);
+  glyph.shelf = shelf_index;
+  return true;
+}
+
+const GlyphAtlas::Glyph *GlyphAtlas::find(uint16_t font_id, int bucket,
+                                          uint32_t codepoint) {
+  uint64_t key = glyph_key(font_id, bucket, codepoint);
+  auto it = glyphs.find(key);
+  if (it == glyphs.end()) {
+    SizedFont *font = find_font(font_id, bucket);
+    Glyph glyph;
+    if (!font || !rasterize(*font, codepoint, glyph)) {
+      return nullptr;
+    }
+    it = glyphs.emplace(key, glyph).first;
+    if (glyph.shelf >= 0) {
+      shelves[glyph.shelf].glyphs.push_back(key);
+    }
+  }
+  if (it->second.shelf >= 0) {
+    shelves[it->second.shelf].last_used_frame = frame;
+  }
+  return &it->second;
+}
+
+bool GlyphAtlas::has_dirty_regions() const {
+  for (const Shelf &shelf : shelves) {
+    if (shelf.dirty_begin < shelf.dirty_end) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void GlyphAtlas::upload(SDL_GPUCopyPass *copy_pass) {
+  struct Region {
+    Uint32 offset;
+    int x, y, width, height;
+  };
+  std::vector<Region> regions;
+
+  uint8_t *data = static_cast<uint8_t *>(
+      SDL_MapGPUTransferBuffer(device, transfer_buffer, true));
+  Uint32 offset = 0;
+  for (Shelf &shelf : shelves) {
+    if (shelf.dirty_begin >= shelf.dirty_end) {
+      continue;
+    }
+    Region region = {offset, shelf.dirty_begin, shelf.y,
+                     shelf.dirty_end - shelf.dirty_begin, shelf.height};
+    for (int row = 0; row < region.height; row++) {
+      memcpy(data + offset + size_t(row) * region.width * 4,
+             &pixels[size_t(region.y + row) * size + region.x],
+             size_t(region.width) * 4);
+    }
+    offset += region.width * region.height * 4;
+    regions.push_back(region);
+    shelf.dirty_begin = size;
+    shelf.dirty_end = 0;
+  }
+  SDL_UnmapGPUTransferBuffer(device, transfer_buffer);
+
+  for (const Region &region : regions) {
+    SDL_GPUTextureTransferInfo transfer_info{};
+    transfer_info.transfer_buffer = transfer_buffer;
+    transfer_info.offset = region.offset;
+    transfer_info.pixels_per_row = region.width;
+    transfer_info.rows_per_layer = region.height;
+    SDL_GPUTextureRegion texture_region{};
+    texture_region.texture = texture;
+    texture_region.x = region.x;
+    texture_region.y = region.y;
+    texture_region.w = region.width;
+    texture_region.h = region.height;
+    texture_region.d = 1;
+    SDL_UploadToGPUTexture(copy_pass, &transfer_info, &texture_region, false);
+  }
+}
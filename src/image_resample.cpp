@@ -0,0 +1,45 @@
+#include "image_resample.hpp"
+
+#include <cstddef>
+
+namespace ImageResample {
+
+void downscale_rgba8(const uint8_t *src, int src_width, int src_height,
+                     int src_pitch, uint8_t *dst, int dst_width,
+                     int dst_height) {
+  for (int dy = 0; dy < dst_height; dy++) {
+    int y0 = static_cast<int>(int64_t(dy) * src_height / dst_height);
+    int y1 = static_cast<int>(int64_t(dy + 1) * src_height / dst_height);
+    if (y1 <= y0) {
+      y1 = y0 + 1;
+    }
+    uint8_t *dst_row = dst + size_t(dy) * dst_width * 4;
+
+    for (int dx = 0; dx < dst_width; dx++) {
+      int x0 = static_cast<int>(int64_t(dx) * src_width / dst_width);
+      int x1 = static_cast<int>(int64_t(dx + 1) * src_width / dst_width);
+      if (x1 <= x0) {
+        x1 = x0 + 1;
+      }
+
+      uint32_t sum[4] = {0, 0, 0, 0};
+      for (int y = y0; y < y1; y++) {
+        const uint8_t *p = src + size_t(y) * src_pitch + size_t(x0) * 4;
+        for (int x = x0; x < x1; x++, p += 4) {
+          sum[0] += p[0];
+          sum[1] += p[1];
+          sum[2] += p[2];
+          sum[3] += p[3];
+        }
+      }
+
+      uint32_t count = uint32_t(x1 - x0) * uint32_t(y1 - y0);
+      uint8_t *out = dst_row + size_t(dx) * 4;
+      for (int c = 0; c < 4; c++) {
+        out[c] = static_cast<uint8_t>((sum[c] + count / 2) / count);
+      }
+    }
+  }
+}
+
+} // namespace ImageResample
@@ -0,0 +1,276 @@
+#include "jpeg_decoder.hpp"
+
+#include "SDL3/SDL_log.h"
+
+#include "config.hpp"
+#include "image_resample.hpp"
+#include "mapped_file.hpp"
+#include "pixel_convert.hpp"
+#include "raw_preview.hpp"
+
+static tjscalingfactor pick_scaling_factor(int width, int target_width) {
+  int num_scaling_factors = 0;
+  tjscalingfactor *scaling_factors = tj3GetScalingFactors(&num_scaling_factors);
+
+  // Smallest factor that still covers the target, so the final resample is
+  // always a (small) downscale
+  tjscalingfactor best = TJUNSCALED;
+  int best_width = width;
+  for (int i = 0; i < num_scaling_factors; i++) {
+    // Upscaling factors are never useful for thumbnails
+    if (scaling_factors[i].num > scaling_factors[i].denom) {
+      continue;
+    }
+    int scaled_width = TJSCALED(width, scaling_factors[i]);
+    if (scaled_width >= target_width && scaled_width < best_width) {
+      best = scaling_factors[i];
+      best_width = scaled_width;
+    }
+  }
+  return best;
+}
+
+// Only ever grows, so steady state decoding never reallocates
+template <typename T>
+static T *reserve_scratch(std::vector<T> &buffer, size_t size) {
+  if (buffer.size() < size) {
+    buffer.resize(size);
+  }
+  return buffer.data();
+}
+
+JpegDecoder::JpegDecoder() {
+  handle = tj3Init(TJINIT_DECOMPRESS);
+  if (!handle) {
+    SDL_Log("ERROR: creating TurboJPEG instance");
+  }
+}
+
+JpegDecoder::~JpegDecoder() {
+  if (handle) {
+    tj3Destroy(handle);
+  }
+}
+
+// Decodes a JPEG held in memory, the buffer stays owned by the caller
+bool JpegDecoder::decode_buffer(const unsigned char *jpeg_buffer,
+                                size_t jpeg_size,
+                                const std::filesystem::path &path,
+                                int target_width, Thumbnail &thumbnail) {
+  // Read JPEG header to get image info
+  if (tj3DecompressHeader(handle, jpeg_buffer, jpeg_size) < 0) {
+    SDL_Log("ERROR: reading JPEG header for %s: %s", path.c_str(),
+            tj3GetErrorStr(handle));
+    return false;
+  }
+
+  int full_width = tj3Get(handle, TJPARAM_JPEGWIDTH);
+  int full_height = tj3Get(handle, TJPARAM_JPEGHEIGHT);
+  int precision = tj3Get(handle, TJPARAM_PRECISION);
+
+  // Let the IDCT do most of the downscaling (1/2, 1/4, 1/8...), lossless
+  // 16-bit JPEGs can't be scaled so those still decode at full size
+  tjscalingfactor scaling_factor = TJUNSCALED;
+  if (precision <= 12) {
+    scaling_factor = pick_scaling_factor(full_width, target_width);
+  }
+  if (tj3SetScalingFactor(handle, scaling_factor) < 0) {
+    SDL_Log("WARNING: setting scaling factor for %s: %s", path.c_str(),
+            tj3GetErrorStr(handle));
+    scaling_factor = TJUNSCALED;
+    tj3SetScalingFactor(handle, scaling_factor);
+  }
+  int width = TJSCALED(full_width, scaling_factor);
+  int height = TJSCALED(full_height, scaling_factor);
+
+  // For some reason, the backwards thing here happens again.
+  // TJPF_RGBA in memory is SDL_PIXELFORMAT_ABGR8888.
+  int pixel_format = TJPF_RGBA;
+  int pixel_size = tjPixelSize[pixel_format];
+  size_t pixel_count = size_t(width) * height;
+  uint8_t *pixels_8bit =
+      reserve_scratch(decode_buffer_8bit, pixel_count * pixel_size);
+
+  // 8 Bit
+  if (precision <= 8) {
+    if (tj3Decompress8(handle, jpeg_buffer, jpeg_size, pixels_8bit, 0,
+                       pixel_format) < 0) {
+      SDL_Log("ERROR: decompressing 8-bit JPEG image %s: %s", path.c_str(),
+              tj3GetErrorStr(handle));
+      return false;
+    }
+  } else { // Handle 12 or 16-bit JPEGs, convert to 8-bit
+    // TurboJPEG outputs unsigned short for precision > 8
+    uint16_t *pixels_16bit =
+        reserve_scratch(decode_buffer_16bit, pixel_count * pixel_size);
+
+    int result;
+    if (precision <= 12) {
+      result = tj3Decompress12(handle, jpeg_buffer, jpeg_size,
+                               (short *)pixels_16bit, 0, pixel_format);
+    } else { // Assume precision <= 16
+      result = tj3Decompress16(handle, jpeg_buffer, jpeg_size, pixels_16bit, 0,
+                               pixel_format);
+    }
+    if (result < 0) {
+      SDL_Log("ERROR: decompressing %d-bit JPEG image %s: %s", precision,
+              path.c_str(), tj3GetErrorStr(handle));
+      return false;
+    }
+
+    // 16-bit (lossless) JPEGs skip DCT scaling, so halve them on the way
+    // down to 8 bits instead of converting pixels that get thrown away
+    if (width >= target_width * 2 && height >= 2) {
+      PixelConvert::rgba16_to_rgba8_half(pixels_16bit, width, height,
+                                         pixels_8bit, precision);
+      width /= 2;
+      height /= 2;
+    } else {
+      PixelConvert::rgba16_to_rgba8(pixels_16bit, pixels_8bit, pixel_count,
+                                    precision);
+    }
+  }
+
+  // Finish with a small resample straight into the thumbnail pixels
+  thumbnail.width = SDL_max(SDL_min(target_width, width), 1);
+  thumbnail.height = SDL_max(
+      static_cast<int>(int64_t(full_height) * thumbnail.width / full_width),
+      1);
+  thumbnail.pixels.resize(size_t(thumbnail.width) * thumbnail.height *
+                          pixel_size);
+  ImageResample::downscale_rgba8(pixels_8bit, width, height,
+                                 width * pixel_size, thumbnail.pixels.data(),
+                                 thumbnail.width, thumbnail.height);
+  return true;
+}
+
+bool JpegDecoder::decode_thumbnail(const std::filesystem::path &path,
+                                   int target_width, Thumbnail &thumbnail) {
+  if (!handle) {
+    return false;
+  }
+
+  // 1. Map the file, nothing is read until a page gets touched. Start out
+  // with random access so peeking at the header doesn't pull in the whole
+  // file through readahead.
+  MappedFile jpeg_file;
+  if (!jpeg_file.open(path, &file_buffer)) {
+    SDL_Log("WARNING: Input file %s is empty or unreadable", path.c_str());
+    return false;
+  }
+  jpeg_file.advise_random();
+  const unsigned char *jpeg_buffer = jpeg_file.data();
+  size_t jpeg_size = jpeg_file.size();
+
+  // Raws can't be decoded here, only the JPEG previews inside them
+  bool is_jpeg =
+      jpeg_size >= 2 && jpeg_buffer[0] == 0xFF && jpeg_buffer[1] == 0xD8;
+
+  // 2. Fast path, use the smallest embedded preview that is big enough
+  if (is_jpeg) {
+    Exif::find_previews(jpeg_buffer, SDL_min(jpeg_size, exif_header_bytes),
+                        jpeg_size, previews);
+  } else if (!RawPreview::find_previews(jpeg_buffer, jpeg_size, previews)) {
+    SDL_Log("WARNING: %s is neither a JPEG nor a raw with a preview",
+            path.c_str());
+    return false;
+  }
+  for (const Exif::EmbeddedImage &preview : previews) {
+    const unsigned char *preview_buffer = jpeg_buffer + preview.offset;
+    jpeg_file.prefetch(preview.offset, preview.length);
+    if (tj3DecompressHeader(handle, preview_buffer, preview.length) < 0 ||
+        tj3Get(handle, TJPARAM_JPEGWIDTH) < target_width) {
+      continue;
+    }
+    if (decode_buffer(preview_buffer, preview.length, path, target_width,
+                      thumbnail)) {
+      return true;
+    }
+  }
+
+  // 3. Slow path, missing or too small preview so decode the image itself.
+  // The decoder walks the file front to back, let the kernel read ahead.
+  if (!is_jpeg) {
+    // Best a raw has to offer is its largest preview
+    const Exif::EmbeddedImage &preview = previews.back();
+    return decode_buffer(jpeg_buffer + preview.offset, preview.length, path,
+                         target_width, thumbnail);
+  }
+  jpeg_file.advise_sequential();
+  jpeg_file.prefetch(0, jpeg_size);
+  return decode_buffer(jpeg_buffer, jpeg_size, path, target_width, thumbnail);
+}
+
+bool JpegDecoder::read_header(const unsigned char *jpeg_buffer,
+                              size_t jpeg_size, int &width, int &height) {
+  if (!handle || tj3DecompressHeader(handle, jpeg_buffer, jpeg_size) < 0) {
+    return false;
+  }
+  width = tj3Get(handle, TJPARAM_JPEGWIDTH);
+  height = tj3Get(handle, TJPARAM_JPEGHEIGHT);
+  return true;
+}
+
+bool JpegDecoder::decode_region(const unsigned char *jpeg_buffer,
+                                size_t jpeg_size, int x, int y, int width,
+                                int height, std::vector<uint8_t> &pixels) {
+  if (!handle || tj3DecompressHeader(handle, jpeg_buffer, jpeg_size) < 0) {
+    return false;
+  }
+  int precision = tj3Get(handle, TJPARAM_PRECISION);
+  if (precision > 12) {
+    SDL_Log("ERROR: region decoding isn't supported for %d-bit JPEGs",
+            precision);
+    return false;
+  }
+
+  // The left edge has to sit on an MCU boundary, decode a bit extra and skip
+  // it when copying out
+  int subsampling = tj3Get(handle, TJPARAM_SUBSAMP);
+  int mcu_width = subsampling >= 0 ? tjMCUWidth[subsampling] : 8;
+  int crop_x = x - x % mcu_width;
+  tjregion region = {crop_x, y, width + (x - crop_x), height};
+
+  tj3SetScalingFactor(handle, TJUNSCALED);
+  if (tj3SetCroppingRegion(handle, region) < 0) {
+    SDL_Log("ERROR: setting cropping region: %s", tj3GetErrorStr(handle));
+    return false;
+  }
+
+  int pixel_format = TJPF_RGBA;
+  int pixel_size = tjPixelSize[pixel_format];
+  size_t crop_pixel_count = size_t(region.w) * region.h;
+  uint8_t *crop_pixels =
+      reserve_scratch(decode_buffer_8bit, crop_pixel_count * pixel_size);
+
+  int result;
+  if (precision <= 8) {
+    result = tj3Decompress8(handle, jpeg_buffer, jpeg_size, crop_pixels, 0,
+                            pixel_format);
+  } else {
+    uint16_t *crop_pixels_16bit =
+        reserve_scratch(decode_buffer_16bit, crop_pixel_count * pixel_size);
+    result = tj3Decompress12(handle, jpeg_buffer, jpeg_size,
+                             (short *)crop_pixels_16bit, 0, pixel_format);
+    if (result >= 0) {
+      PixelConvert::rgba16_to_rgba8(crop_pixels_16bit, crop_pixels,
+                                    crop_pixel_count, precision);
+    }
+  }
+  // Thumbnails decode with the same handle
+  tj3SetCroppingRegion(handle, TJUNCROPPED);
+  if (result < 0) {
+    SDL_Log("ERROR: decompressing JPEG region: %s", tj3GetErrorStr(handle));
+    return false;
+  }
+
+  size_t row_size = size_t(width) * pixel_size;
+  size_t crop_row_size = size_t(region.w) * pixel_size;
+  size_t skip = size_t(x - crop_x) * pixel_size;
+  pixels.resize(row_size * height);
+  for (int row = 0; row < height; row++) {
+    SDL_memcpy(pixels.data() + row * row_size,
+               crop_pixels + row * crop_row_size + skip, row_size);
+  }
+  return true;
+}
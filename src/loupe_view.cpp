@@ -0,0 +1,325 @@
+#include "loupe_view.hpp"
+
+#include <cmath>
+
+#include "SDL3/SDL_log.h"
+#include "glm/common.hpp"
+
+#include "config.hpp"
+#include "jpeg_decoder.hpp"
+#include "raw_preview.hpp"
+
+LoupeView::LoupeView() : results(64), residency(loupe_tile_budget) {}
+
+LoupeView::~LoupeView() { stop(); }
+
+bool LoupeView::start(unsigned int worker_count) {
+  if (running) {
+    return true;
+  }
+  running = true;
+  results.reopen();
+  for (unsigned int i = 0; i < SDL_max(worker_count, 1u); i++) {
+    workers.emplace_back(&LoupeView::worker_main, this);
+  }
+  return true;
+}
+
+void LoupeView::stop() {
+  {
+    std::lock_guard<std::mutex> lock(jobs_mutex);
+    if (!running) {
+      return;
+    }
+    running = false;
+    jobs.clear();
+  }
+  jobs_available.notify_all();
+  results.close();
+
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  workers.clear();
+  results.clear();
+}
+
+bool LoupeView::open(Renderer &renderer, const std::filesystem::path &path) {
+  close(renderer);
+
+  auto mapped = std::make_shared<MappedFile>();
+  if (!mapped->open(path)) {
+    SDL_Log("Failed to open %s for the loupe", path.c_str());
+    return false;
+  }
+  // Tiles are decoded out of order
+  mapped->advise_random();
+
+  // Raws show their largest embedded preview
+  jpeg_offset = 0;
+  jpeg_length = mapped->size();
+  if (mapped->size() < 2 || mapped->data()[0] != 0xFF ||
+      mapped->data()[1] != 0xD8) {
+    std::vector<Exif::EmbeddedImage> previews;
+    if (!RawPreview::find_previews(mapped->data(), mapped->size(), previews)) {
+      SDL_Log("No JPEG preview found in %s", path.c_str());
+      return false;
+    }
+    jpeg_offset = previews.back().offset;
+    jpeg_length = previews.back().length;
+  }
+
+  JpegDecoder decoder;
+  if (!decoder.read_header(mapped->data() + jpeg_offset, jpeg_length,
+                           image_width, image_height)) {
+    SDL_Log("Failed to read JPEG header of %s", path.c_str());
+    return false;
+  }
+
+  columns = (image_width + loupe_tile_size - 1) / loupe_tile_size;
+  rows = (image_height + loupe_tile_size - 1) / loupe_tile_size;
+  tile_states.assign(size_t(columns) * rows, TILE_MISSING);
+  tile_failures.assign(tile_states.size(), 0);
+  tile_names.resize(tile_states.size());
+  for (int row = 0; row < rows; row++) {
+    for (int column = 0; column < columns; column++) {
+      tile_names[size_t(row) * columns + column] =
+          "LOUPE_TILE_" + std::to_string(column) + "_" + std::to_string(row);
+    }
+  }
+  center = glm::vec2(image_width, image_height) / 2.0f;
+  file = std::move(mapped);
+  return true;
+}
+
+void LoupeView::close(Renderer &renderer) {
+  {
+    // In flight tiles of the old image get dropped by generation
+    std::lock_guard<std::mutex> lock(jobs_mutex);
+    jobs.clear();
+    generation++;
+  }
+  results.clear();
+  destroy_tiles(renderer);
+  file.reset();
+}
+
+void LoupeView::destroy_tiles(Renderer &renderer) {
+  for (size_t i = 0; i < tile_states.size(); i++) {
+    if (tile_states[i] == TILE_RESIDENT) {
+      renderer.destroy_texture(tile_names[i]);
+    }
+  }
+  tile_states.clear();
+  tile_failures.clear();
+  residency.clear();
+}
+
+void LoupeView::pan(glm::vec2 delta) { center += delta; }
+
+// Requested again next frame, until it runs out of attempts
+void LoupeView::tile_failed(size_t key) {
+  tile_failures[key]++;
+  tile_states[key] = tile_failures[key] < loupe_tile_max_attempts
+                         ? TILE_MISSING
+                         : TILE_FAILED;
+}
+
+void LoupeView::upload_ready(Renderer &renderer) {
+  ready.clear();
+  uploads.clear();
+
+  LoupeTile tile;
+  while (ready.size() < 8 && results.try_pop(tile)) {
+    if (tile.generation != generation) {
+      continue;
+    }
+    if (tile.failed) {
+      tile_failed(size_t(tile.row) * columns + tile.column);
+      continue;
+    }
+    ready.push_back(std::move(tile));
+  }
+  for (const LoupeTile &item : ready) {
+    uploads.push_back(TextureUpload{
+        .path = tile_names[size_t(item.row) * columns + item.column],
+        .width = item.width,
+        .height = item.height,
+        .pixels = item.pixels.data(),
+    });
+  }
+  if (uploads.empty()) {
+    return;
+  }
+  if (!renderer.load_textures(uploads)) {
+    for (const LoupeTile &item : ready) {
+      tile_failed(size_t(item.row) * columns + item.column);
+    }
+    return;
+  }
+  for (const LoupeTile &item : ready) {
+    size_t key = size_t(item.row) * columns + item.column;
+    tile_states[key] = TILE_RESIDENT;
+    residency.add(key, item.pixels.size());
+  }
+}
+
+void LoupeView::draw(Renderer &renderer) {
+  if (!file) {
+    return;
+  }
+  residency.begin_frame();
+  upload_ready(renderer);
+
+  // Everything here is in physical pixels, the renderer draws in points
+  float scale = renderer.viewport_scale;
+  glm::vec2 view_size(renderer.width, renderer.height);
+  glm::vec2 image_size(image_width, image_height);
+  // Small images stay centered, big ones can't be panned past their edges
+  for (int axis = 0; axis < 2; axis++) {
+    if (image_size[axis] <= view_size[axis]) {
+      center[axis] = image_size[axis] / 2.0f;
+    } else {
+      center[axis] = SDL_clamp(center[axis], view_size[axis] / 2.0f,
+                               image_size[axis] - view_size[axis] / 2.0f);
+    }
+  }
+  glm::vec2 origin = glm::floor(center - view_size / 2.0f);
+
+  renderer.draw_color_rect(glm::vec2(0.0f), view_size / scale,
+                           glm::vec4(0.05f, 0.05f, 0.05f, 1.0f),
+                           glm::vec4(0.0f));
+
+  int first_column = SDL_max(
+      static_cast<int>(std::floor(origin.x / loupe_tile_size)), 0);
+  int first_row =
+      SDL_max(static_cast<int>(std::floor(origin.y / loupe_tile_size)), 0);
+  int last_column = SDL_min(
+      static_cast<int>(std::ceil((origin.x + view_size.x) / loupe_tile_size)),
+      columns);
+  int last_row = SDL_min(
+      static_cast<int>(std::ceil((origin.y + view_size.y) / loupe_tile_size)),
+      rows);
+
+  // One ring of tiles around the view gets decoded ahead of panning, queued
+  // jobs outside of it are dropped
+  int prefetch_first_column = SDL_max(first_column - 1, 0);
+  int prefetch_first_row = SDL_max(first_row - 1, 0);
+  int prefetch_last_column = SDL_min(last_column + 1, columns);
+  int prefetch_last_row = SDL_min(last_row + 1, rows);
+  {
+    std::lock_guard<std::mutex> lock(jobs_mutex);
+    auto kept = jobs.begin();
+    for (auto it = jobs.begin(); it != jobs.end(); ++it) {
+      if (it->column >= prefetch_first_column &&
+          it->column < prefetch_last_column &&
+          it->row >= prefetch_first_row && it->row < prefetch_last_row) {
+        if (kept != it) {
+          *kept = std::move(*it);
+        }
+        ++kept;
+      } else {
+        tile_states[size_t(it->row) * columns + it->column] = TILE_MISSING;
+      }
+    }
+    jobs.erase(kept, jobs.end());
+  }
+
+  auto request = [this](int column, int row, bool visible) {
+    TileState &state = tile_states[size_t(row) * columns + column];
+    if (state != TILE_MISSING) {
+      return;
+    }
+    if (visible) {
+      residency.count_miss();
+    }
+    state = TILE_REQUESTED;
+    std::lock_guard<std::mutex> lock(jobs_mutex);
+    jobs.push_back(LoupeTileJob{
+        .column = column,
+        .row = row,
+        .generation = generation,
+        .file = file,
+        .jpeg_offset = jpeg_offset,
+        .jpeg_length = jpeg_length,
+    });
+  };
+
+  for (int row = first_row; row < last_row; row++) {
+    for (int column = first_column; column < last_column; column++) {
+      size_t key = size_t(row) * columns + column;
+      glm::vec2 tile_position =
+          glm::vec2(column, row) * static_cast<float>(loupe_tile_size);
+      glm::vec2 tile_size = glm::min(
+          glm::vec2(static_cast<float>(loupe_tile_size)),
+          image_size - tile_position);
+      glm::vec2 position = (tile_position - origin) / scale;
+      if (residency.touch(key)) {
+        renderer.draw_texture_rect(tile_names[key], position,
+                                   tile_size / scale, glm::vec4(1.0f),
+                                   glm::vec4(0.0f), false);
+      } else {
+        renderer.draw_color_rect(position, tile_size / scale,
+                                 glm::vec4(0.1f, 0.1f, 0.1f, 1.0f),
+                                 glm::vec4(0.0f));
+        request(column, row, true);
+      }
+    }
+  }
+  for (int row = prefetch_first_row; row < prefetch_last_row; row++) {
+    for (int column = prefetch_first_column; column < prefetch_last_column;
+         column++) {
+      request(column, row, false);
+    }
+  }
+  jobs_available.notify_all();
+
+  evicted.clear();
+  residency.evict(evicted);
+  for (size_t key : evicted) {
+    renderer.destroy_texture(tile_names[key]);
+    tile_states[key] = TILE_MISSING;
+  }
+}
+
+void LoupeView::worker_main() {
+  JpegDecoder decoder;
+
+  while (true) {
+    LoupeTileJob job;
+    {
+      std::unique_lock<std::mutex> lock(jobs_mutex);
+      jobs_available.wait(lock, [this] { return !running || !jobs.empty(); });
+      if (!running) {
+        return;
+      }
+      job = std::move(jobs.front());
+      jobs.pop_front();
+      if (job.generation != generation) {
+        continue;
+      }
+    }
+
+    LoupeTile tile;
+    tile.column = job.column;
+    tile.row = job.row;
+    tile.generation = job.generation;
+    tile.width = 0;
+    tile.height = 0;
+    tile.failed = true;
+    const unsigned char *jpeg_buffer = job.file->data() + job.jpeg_offset;
+    int width = 0;
+    int height = 0;
+    if (decoder.read_header(jpeg_buffer, job.jpeg_length, width, height)) {
+      int x = job.column * loupe_tile_size;
+      int y = job.row * loupe_tile_size;
+      tile.width = SDL_min(loupe_tile_size, width - x);
+      tile.height = SDL_min(loupe_tile_size, height - y);
+      tile.failed = !decoder.decode_region(jpeg_buffer, job.jpeg_length, x, y,
+                                           tile.width, tile.height,
+                                           tile.pixels);
+    }
+    // Failures go back too, so the tile doesn't stay requested forever
+    results.push(std::move(tile));
+  }
+}
@@ -1,17 +1,17 @@
+#include <algorithm>
 #include <cmath>
 #include <cstdint>
 #include <filesystem>
-#include <fstream>
 #include <sstream>
 #include <string>
 #include <sys/types.h>
+#include <unordered_map>
 #include <vector>
 
 // Libraries
 #include "SDL3/SDL_log.h"
 #include "SDL3/SDL_surface.h"
 #include "SDL3_image/SDL_image.h"
-#include "turbojpeg.h"
 
 #define CLAY_IMPLEMENTATION
 #include "clay.h"
@@ -19,7 +19,17 @@
 
 #include "clay_renderer.hpp"
 #include "config.hpp"
+#include "directory_scanner.hpp"
+#include "folder_watcher.hpp"
+#include "loupe_view.hpp"
+#include "photo_loader.hpp"
+#include "photo_mover.hpp"
+#include "quad_bench.hpp"
+#include "raw_preview.hpp"
+#include "selection_sidecar.hpp"
+#include "selection_set.hpp"
 #include "renderer.hpp"
+#include "texture_residency.hpp"
 
 // Entities
 #include "component_storage.hpp"
@@ -45,6 +55,9 @@ const Clay_Color COLOR_SELECTED_GREEN = {127, 255, 0, 255};
 uint16_t shut_up_data[1];
 
 Renderer renderer;
+PhotoLoader photo_loader;
+TextureResidency thumbnail_residency(thumbnail_vram_budget);
+LoupeView loupe_view;
 
 ImageData edge_sheen_data;
 ImageData carbon_fiber_data;
@@ -54,46 +67,100 @@ ImageData check_data;
 
 struct Photo {
   ImageData image_data;
-  bool selected;
-  std::filesystem::path file_path;
+  uint32_t selection_id;   // Bit in the selection sidecar
+  int requested_level;     // Thumbnail level in flight, -1 if none
+  int failed_requests;     // Thumbnail requests that failed so far
+  uint32_t loaded_levels;  // Bit per resident thumbnail level
+  std::filesystem::path file_path; // Decoded for the thumbnail
+  std::filesystem::path pair_path; // Other half of a RAW+JPEG pair, or empty
 };
 
 // std::string photos_root_path = "res/FUJI/";
 std::vector<Photo> photos;
+std::filesystem::path photos_root_path;
+DirectoryScanner directory_scanner;
+std::vector<ScannedPhoto> scanned_photos;
+FolderWatcher folder_watcher;
+std::vector<FolderEvent> folder_events;
+// Folder and stem -> index in photos, for pairs the scanner couldn't match
+std::unordered_map<std::string, size_t> photo_by_stem;
 bool folder_opened = false;
 
-std::string tally_label;
+// Selected state of photos[i] is bit i
+SelectionSet photo_selection;
+std::string tally_label = "0";
+size_t tally_count = 0; // Selection count tally_label was made for
+SelectionSidecar selection_sidecar;
+
+PhotoMover photo_mover;
+std::string finalize_label; // Progress while photo_mover is busy
+
+// Photo under the pointer as of the last layout, opened by the loupe
+Photo *hovered_photo = nullptr;
+
+// Rows of the photo grid that are on screen, from the previous frame's layout
+struct PhotoGridView {
+  int columns = 1;
+  int first_row = 0; // Inclusive
+  int last_row = 0;  // Exclusive
+  int scroll_direction = 1; // 1 is down, -1 is up
+  float image_width = 0.0f; // Thumbnail width in layout units
+  int level = 0;             // Thumbnail level drawn at image_width
+  float scroll = 0.0f;
+  float row_height = 0.0f;
+};
+PhotoGridView photo_grid_view;
+std::vector<size_t> dropped_thumbnail_requests;
+std::vector<size_t> evicted_thumbnails;
+
+// Queues every photo for a move into Curated or Discarded, the files get
+// moved on photo_mover's thread
+bool seperate_photos(std::vector<Photo> &photos,
+                     const std::filesystem::path &root_path) {
+  std::filesystem::create_directories(root_path / "Curated");
+  std::filesystem::create_directories(root_path / "Discarded");
 
-// Technically very inefficient, not sure
-int get_selected_photos_count() {
-  int count = 0;
-  for (auto photo : photos) {
-    if (photo.selected) {
-      count++;
+  // RAW+JPEG pairs always end up in the same folder
+  std::vector<FileMove> moves;
+  for (size_t i = 0; i < photos.size(); i++) {
+    const Photo &photo = photos[i];
+    std::filesystem::path folder =
+        root_path / (photo_selection.test(i) ? "Curated" : "Discarded");
+    moves.push_back({photo.file_path, folder / photo.file_path.filename()});
+    if (!photo.pair_path.empty()) {
+      moves.push_back({photo.pair_path, folder / photo.pair_path.filename()});
     }
   }
-  return count;
+  return photo_mover.start(std::move(moves),
+                           FinalizeJournal::path_for(root_path));
 }
 
-bool seperate_photos(std::vector<Photo> &photos) {
-  std::filesystem::path root_path(photos[0].file_path.parent_path());
+void update_finalize_label() {
+  PhotoMover::Progress progress = photo_mover.get_progress();
+  int percent = 0;
+  if (progress.byte_count > 0) {
+    percent = static_cast<int>(progress.bytes_done * 100 / progress.byte_count);
+  }
+  std::stringstream ss;
+  ss << "Moving " << progress.files_done << "/" << progress.file_count << " ("
+     << percent << "%, " << static_cast<int>(progress.bytes_per_second / 1e6)
+     << " MB/s)";
+  finalize_label = ss.str();
+}
 
-  std::filesystem::create_directories(root_path / "Curated");
-  std::filesystem::create_directories(root_path / "Discarded");
+// One residency entry per photo and thumbnail level
+size_t thumbnail_residency_key(size_t index, int level) {
+  return index * thumbnail_level_count + level;
+}
 
-  for (auto &photo : photos) {
-    if (photo.selected) {
-      std::filesystem::copy_file(
-          photo.file_path, root_path / "Curated" / photo.file_path.filename(),
-          std::filesystem::copy_options::overwrite_existing);
-    } else {
-      std::filesystem::copy_file(
-          photo.file_path, root_path / "Discarded" / photo.file_path.filename(),
-          std::filesystem::copy_options::overwrite_existing);
+// Frees the GPU textures of every photo, before the photo list goes away
+void unload_photo_textures() {
+  for (Photo &photo : photos) {
+    if (photo.loaded_levels) {
+      renderer.destroy_texture(photo.image_data.path);
     }
-    std::filesystem::remove(photo.file_path);
   }
-  return true;
+  thumbnail_residency.clear();
 }
 
 bool load_photos(std::filesystem::path path) {
@@ -102,252 +169,201 @@ bool load_photos(std::filesystem::path path) {
     return 1;
   }
 
+  directory_scanner.cancel();
+  loupe_view.close(renderer);
+  photo_loader.cancel();
+  photo_loader.open_cache(path);
+  unload_photo_textures();
   photos.clear();
+  photo_selection.clear();
+  photo_grid_view = PhotoGridView{};
+
+  photo_by_stem.clear();
+  photos_root_path = path;
+  // Selections from an earlier session come back as the photos stream in
+  selection_sidecar.open(path);
+
+  // Watch first, so nothing written during the scan slips through. Files
+  // reported by both are only added once.
+  folder_watcher.watch(path);
+
+  // Finish a finalize that got cut short, the watcher drops the photos from
+  // the grid as they get moved out. Left for later if a batch is running.
+  std::filesystem::path journal_path = FinalizeJournal::path_for(path);
+  std::vector<FileMove> pending_moves;
+  if (!photo_mover.is_busy() &&
+      FinalizeJournal::read_pending(journal_path, pending_moves)) {
+    SDL_Log("Resuming an interrupted finalize, %zu files left",
+            pending_moves.size());
+    photo_mover.start(std::move(pending_moves), journal_path, true);
+  }
 
-  for (const std::filesystem::directory_entry &entry :
-       std::filesystem::directory_iterator(path)) {
-    if (entry.is_regular_file()) {
-      SDL_Log("Loading file: %s", entry.path().c_str());
-      // std::cout << "Loading file: " << entry.path() << std::endl;
-
-      ImageData photo_image_data{};
-      photo_image_data.path = entry.path().string();
-      photo_image_data.tiling = false;
-
-      Photo photo{};
-      photo.image_data = photo_image_data;
-      photo.selected = false;
-      photo.file_path = entry.path();
-
-      photos.push_back(photo);
+  directory_scanner.start(path);
 
-      std::ifstream jpegStream(entry.path());
-      if (!jpegStream.is_open()) {
-        SDL_Log("ERROR: opening input file %s: %s", entry.path().c_str(),
-                strerror(errno));
-      }
-
-      jpegStream.seekg(0, std::ios::end);
-      std::streampos size = jpegStream.tellg();
-      if (size == 0) {
-        SDL_Log("WARNING: Input file contains no data");
-      }
-      jpegStream.seekg(0, std::ios::beg);
-      size_t jpegSize = static_cast<size_t>(size);
+  // Nothing gets decoded here, photos stream in from the scanner (see
+  // add_scanned_photos) and the grid requests thumbnails for the rows it
+  // shows (see request_visible_thumbnails)
+  return true;
+}
 
-      unsigned char *jpegBuf = (unsigned char *)malloc(jpegSize);
-      if (!jpegBuf) {
-        SDL_Log("ERROR: allocating JPEG buffer");
-      }
+std::string photo_stem_key(const std::filesystem::path &path) {
+  return (path.parent_path() / path.stem()).string();
+}
 
-      jpegStream.read(reinterpret_cast<char *>(jpegBuf), jpegSize);
-      jpegStream.close();
+// Adds a photo file to the end of the grid. Raws pair up with the JPEG of
+// the same name (DSCF0001.RAF and DSCF0001.JPG) into one grid item, the
+// first one added stays the decoded one so nothing already requested
+// changes path. Files already in the grid are skipped, the scanner and the
+// folder watcher can both report the same one.
+void add_photo_file(std::filesystem::path file_path) {
+  std::string key = photo_stem_key(file_path);
+  auto pair = photo_by_stem.find(key);
+  if (pair != photo_by_stem.end()) {
+    Photo &photo = photos[pair->second];
+    if (photo.file_path == file_path || photo.pair_path == file_path) {
+      return;
+    }
+    if (photo.pair_path.empty() &&
+        RawPreview::is_raw(file_path) != RawPreview::is_raw(photo.file_path)) {
+      SDL_Log("Pairing file: %s", file_path.c_str());
+      photo.pair_path = std::move(file_path);
+      return;
+    }
+  }
 
-      // 2. Initialize TurboJPEG decompressor
-      tjhandle tjInstance = tj3Init(TJINIT_DECOMPRESS);
-      if (!tjInstance) {
-        SDL_Log("ERROR: creating TurboJPEG instance");
-      }
+  ImageData photo_image_data{};
+  photo_image_data.path = file_path.string();
+  photo_image_data.tiling = false;
+
+  Photo photo{};
+  photo.image_data = photo_image_data;
+  photo.selection_id = selection_sidecar.find_or_add(file_path);
+  photo.requested_level = -1;
+  photo.failed_requests = 0;
+  photo.loaded_levels = 0;
+  photo.file_path = std::move(file_path);
+
+  photo_by_stem.emplace(std::move(key), photos.size());
+  photo_selection.push_back(selection_sidecar.is_selected(photo.selection_id));
+  photos.push_back(std::move(photo));
+}
 
-      // 3. Read JPEG header to get image info
-      int jpegWidth, jpegHeight, jpegSubsamp, jpegColorspace, jpegPrecision;
-      if (tj3DecompressHeader(tjInstance, jpegBuf, jpegSize) < 0) {
-        SDL_Log("ERROR: reading JPEG header for %s: %s", entry.path().c_str(),
-                tj3GetErrorStr(tjInstance));
-      }
+// Adds whatever the scanner found since last frame to the end of the grid.
+// The scanner already pairs files that are close together in the listing,
+// the JPEG is then the one decoded since its scaled previews make it
+// cheaper.
+void add_scanned_photos() {
+  scanned_photos.clear();
+  if (!directory_scanner.poll(scanned_photos)) {
+    return;
+  }
+  // photos may reallocate
+  hovered_photo = nullptr;
 
-      jpegWidth = tj3Get(tjInstance, TJPARAM_JPEGWIDTH);
-      jpegHeight = tj3Get(tjInstance, TJPARAM_JPEGHEIGHT);
-      jpegSubsamp = tj3Get(tjInstance, TJPARAM_SUBSAMP);
-      jpegColorspace = tj3Get(tjInstance, TJPARAM_COLORSPACE);
-      jpegPrecision = tj3Get(tjInstance, TJPARAM_PRECISION);
-
-      // --- Prepare for Decompression and SDL Surface Creation ---
-      // We'll target 8-bit per channel output for SDL_Surface compatibility.
-      // If the JPEG is higher precision, we'll convert it.
-
-      // For general compatibility, decompres to BGRX (32-bit per pixel)
-      // For some reason, the backwards thing here happens again
-      int tjDecompressFormat = TJPF_RGBA;
-      SDL_PixelFormat sdlPixelFormat = SDL_PIXELFORMAT_ABGR8888;
-      int sdlPixelSize =
-          tjPixelSize[tjDecompressFormat]; // Will be 4 bytes for TJPF_BGRX
-
-      // Check for higher precision JPEGs
-      unsigned char *decompressedBuf_8bit =
-          NULL; // This will hold the final 8-bit data for SDL
-      void *tjOutputRawBuf = NULL; // Intermediate buffer if precision > 8
-      int tjOutputRawBufSize = 0;
-
-      // 8 Bit
-      if (jpegPrecision <= 8) {
-        tjOutputRawBufSize =
-            jpegWidth * jpegHeight * sdlPixelSize; // Size for 8-bit data
-        tjOutputRawBuf = malloc(tjOutputRawBufSize);
-        if (!tjOutputRawBuf) {
-          SDL_Log("ERROR: allocating 8-bit TurboJPEG output buffer for %s: %s",
-                  entry.path().c_str(), strerror(errno));
-          // goto cleanup_loop;
-        }
-        if (tj3Decompress8(tjInstance, jpegBuf, jpegSize,
-                           (unsigned char *)tjOutputRawBuf, 0,
-                           tjDecompressFormat) < 0) {
-          SDL_Log("ERROR: decompressing 8-bit JPEG image %s: %s",
-                  entry.path().c_str(), tj3GetErrorStr(tjInstance));
-          free(tjOutputRawBuf); // Decompression failed, free buffer
-          // goto cleanup_loop;
-        }
-        decompressedBuf_8bit =
-            (unsigned char *)tjOutputRawBuf; // Direct use for 8-bit
-        // SDL will take ownership of decompressedBuf_8bit later, so don't free
-        // it here
-        tjOutputRawBuf =
-            NULL; // Clear pointer to prevent double free via cleanup_loop
-      } else {    // Handle 12 or 16-bit JPEGs, convert to 8-bit for SDL
-        SDL_Log("WARNING: JPEG %s has precision %d > 8 bits. Converting to "
-                "8-bit per channel.",
-                entry.path().c_str(), jpegPrecision);
-
-        // TurboJPEG outputs unsigned short for precision > 8
-        int tjIntermediatePixelSize_16bit =
-            tjPixelSize[tjDecompressFormat] *
-            sizeof(unsigned short); // e.g., 4 channels * 2 bytes/channel = 8
-                                    // bytes/pixel
-        tjOutputRawBufSize =
-            jpegWidth * jpegHeight * tjIntermediatePixelSize_16bit;
-        tjOutputRawBuf = malloc(tjOutputRawBufSize);
-        if (!tjOutputRawBuf) {
-          SDL_Log("ERROR: allocating 16-bit TurboJPEG intermediate buffer for "
-                  "%s: %s",
-                  entry.path().c_str(), strerror(errno));
-          // goto cleanup_loop;
-        }
+  for (ScannedPhoto &scanned : scanned_photos) {
+    add_photo_file(std::move(scanned.file_path));
+    if (!scanned.pair_path.empty()) {
+      add_photo_file(std::move(scanned.pair_path));
+    }
+  }
+}
 
-        // 12 Bit
-        if (jpegPrecision <= 12) {
-          if (tj3Decompress12(tjInstance, jpegBuf, jpegSize,
-                              (short int *)tjOutputRawBuf, 0,
-                              tjDecompressFormat) < 0) {
-            SDL_Log("ERROR: decompressing 12-bit JPEG image %s: %s",
-                    entry.path().c_str(), tj3GetErrorStr(tjInstance));
-            free(tjOutputRawBuf);
-            // goto cleanup_loop;
-          }
-          // 12 Bit
-        } else { // Assume precision <= 16
-          if (tj3Decompress16(tjInstance, jpegBuf, jpegSize,
-                              (unsigned short *)tjOutputRawBuf, 0,
-                              tjDecompressFormat) < 0) {
-            SDL_Log("ERROR: decompressing 16-bit JPEG image %s: %s",
-                    entry.path().c_str(), tj3GetErrorStr(tjInstance));
-            free(tjOutputRawBuf);
-            // goto cleanup_loop;
-          }
-        }
+// Index of the photo showing path, either half of a pair, or photos.size()
+size_t find_photo(const std::filesystem::path &path) {
+  auto match = [&path](const Photo &photo) {
+    return photo.file_path == path || photo.pair_path == path;
+  };
+  auto it = photo_by_stem.find(photo_stem_key(path));
+  if (it != photo_by_stem.end() && match(photos[it->second])) {
+    return it->second;
+  }
+  // Two photos can share a stem (DSCF0001.JPG and DSCF0001.jpeg)
+  return std::find_if(photos.begin(), photos.end(), match) - photos.begin();
+}
 
-        // Now, convert the 16-bit (unsigned short) tjOutputRawBuf to 8-bit
-        // (unsigned char) decompressedBuf_8bit
-        decompressedBuf_8bit = (unsigned char *)malloc(
-            jpegWidth * jpegHeight * sdlPixelSize); // Final 8-bit size
-        if (!decompressedBuf_8bit) {
-          SDL_Log("ERROR: allocating 8-bit conversion buffer for %s: %s",
-                  entry.path().c_str(), strerror(errno));
-          free(tjOutputRawBuf);
-          // goto cleanup_loop;
-        }
+void unload_photo_thumbnails(size_t index) {
+  Photo &photo = photos[index];
+  if (photo.loaded_levels) {
+    renderer.destroy_texture(photo.image_data.path);
+  }
+  photo.loaded_levels = 0;
+}
 
-        unsigned short *src_ptr = (unsigned short *)tjOutputRawBuf;
-        unsigned char *dst_ptr = decompressedBuf_8bit;
+// Follows changes to the open folder without rescanning it. Only the
+// thumbnails of rewritten or removed photos are thrown away, the disk cache
+// notices a rewritten file by its stamp.
+void apply_folder_events() {
+  folder_events.clear();
+  if (!folder_watcher.poll(folder_events)) {
+    return;
+  }
+  hovered_photo = nullptr;
+
+  bool invalidated = false;
+  bool removed = false;
+  for (FolderEvent &event : folder_events) {
+    if (event.type == FolderEvent::RESCAN) {
+      SDL_Log("Lost track of %s, rescanning", photos_root_path.c_str());
+      load_photos(photos_root_path);
+      return;
+    }
 
-        // Loop through pixels and convert
-        for (int i = 0; i < jpegWidth * jpegHeight; ++i) {
-          // Assuming TJPF_BGRX output (4 channels per pixel)
-          *dst_ptr++ = (unsigned char)(*src_ptr++ >> 8); // B
-          *dst_ptr++ = (unsigned char)(*src_ptr++ >> 8); // G
-          *dst_ptr++ = (unsigned char)(*src_ptr++ >> 8); // R
-          *dst_ptr++ = (unsigned char)0xFF; // X/Alpha (fully opaque)
+    size_t index = find_photo(event.path);
+    if (event.type == FolderEvent::FILE_WRITTEN) {
+      if (index == photos.size()) {
+        add_photo_file(std::move(event.path));
+      } else if (photos[index].file_path == event.path) {
+        unload_photo_thumbnails(index);
+        for (int level = 0; level < thumbnail_level_count; level++) {
+          thumbnail_residency.remove(thumbnail_residency_key(index, level));
         }
-        free(tjOutputRawBuf); // Free the intermediate 16-bit buffer
-        tjOutputRawBuf = NULL;
-      }
-
-      // 4. Create an SDL_Surface from the decompressed 8-bit data
-      // Using the new SDL3 function: SDL_CreateSurfaceFrom
-      SDL_Surface *original_image_surface = SDL_CreateSurfaceFrom(
-          jpegWidth,      // Width
-          jpegHeight,     // Height
-          sdlPixelFormat, // SDL Pixel Format (e.g., SDL_PIXELFORMAT_BGRX8888)
-          decompressedBuf_8bit,    // Pointer to existing pixel data (8-bit)
-          jpegWidth * sdlPixelSize // Pitch (bytes per row)
-      );
-
-      // Important: According to SDL3 wiki for SDL_CreateSurfaceFrom,
-      // "Pixel data is not managed automatically; you must free the surface
-      // before you free the pixel data."
-      // This means SDL *does NOT* take ownership of decompressedBuf_8bit,
-      // and we MUST free it ourselves *after* Destroying
-      // original_image_surface. This is a crucial change from SDL2's
-      // SDL_CreateRGBSurfaceWithFormatFrom!
-
-      if (original_image_surface == NULL) {
-        SDL_Log("ERROR: Failed to create SDL_Surface from decompressed data "
-                "for %s: %s",
-                entry.path().c_str(), SDL_GetError());
-        free(decompressedBuf_8bit); // SDL didn't take ownership, so we must
-                                    // free.
-        // goto cleanup_loop;
-      }
-
-      // 5. Downsample the image
-      int downsample_factor = 10;
-      int thumbWidth = original_image_surface->w / downsample_factor;
-      int thumbHeight = original_image_surface->h / downsample_factor;
-      if (thumbWidth == 0)
-        thumbWidth = 1; // Ensure minimum 1 pixel
-      if (thumbHeight == 0)
-        thumbHeight = 1;
-
-      SDL_Surface *downsampled = SDL_CreateSurface(
-          thumbWidth, thumbHeight,
-          original_image_surface
-              ->format); // SDL_CreateSurface (new in SDL3 for simpler creation)
-
-      if (downsampled == NULL) {
-        SDL_Log("ERROR: Failed to create downsampled SDL_Surface for %s: %s",
-                entry.path().c_str(), SDL_GetError());
-        SDL_DestroySurface(original_image_surface);
-        free(decompressedBuf_8bit); // Must free this explicitly!
-        // goto cleanup_loop;
+        invalidated = true;
       }
+      continue;
+    }
 
-      SDL_Rect src_rect = {0, 0, original_image_surface->w,
-                           original_image_surface->h};
-      SDL_Rect dst_rect = {0, 0, thumbWidth, thumbHeight};
-
-      if (!SDL_BlitSurfaceScaled(original_image_surface, &src_rect, downsampled,
-                                 &dst_rect, SDL_SCALEMODE_LINEAR)) {
-        SDL_Log("ERROR: Failed to scale surface for %s: %s",
-                entry.path().c_str(), SDL_GetError());
-        SDL_DestroySurface(original_image_surface);
-        free(decompressedBuf_8bit); // Must free this explicitly!
-        SDL_DestroySurface(downsampled);
-        // goto cleanup_loop;
+    // FILE_REMOVED
+    if (index == photos.size()) {
+      continue;
+    }
+    Photo &photo = photos[index];
+    if (photo.pair_path == event.path) {
+      photo.pair_path.clear();
+      continue;
+    }
+    unload_photo_thumbnails(index);
+    if (!photo.pair_path.empty()) {
+      // The other half takes over
+      for (int level = 0; level < thumbnail_level_count; level++) {
+        thumbnail_residency.remove(thumbnail_residency_key(index, level));
       }
-
-      // 6. Load texture into your renderer
-      renderer.load_texture(entry.path().string(), downsampled);
-
-      // 7. Clean up surfaces and TurboJPEG instance
-      SDL_DestroySurface(original_image_surface);
-      free(decompressedBuf_8bit); // CRITICAL: Free the buffer that
-                                  // original_image_surface pointed to
-      SDL_DestroySurface(downsampled);
-      free(jpegBuf);
-      tj3Destroy(tjInstance);
+      photo.file_path = std::move(photo.pair_path);
+      photo.pair_path.clear();
+      photo.image_data.path = photo.file_path.string();
+    } else {
+      thumbnail_residency.erase_range(thumbnail_residency_key(index, 0),
+                                      thumbnail_level_count);
+      photos.erase(photos.begin() + index);
+      photo_selection.erase(index);
+      removed = true;
     }
+    invalidated = true;
   }
 
-  return true;
+  if (removed) {
+    photo_by_stem.clear();
+    for (size_t i = 0; i < photos.size(); i++) {
+      photo_by_stem.emplace(photo_stem_key(photos[i].file_path), i);
+    }
+  }
+  // Requests in flight carry indices and paths that may be stale now, the
+  // grid asks again for whatever is still on screen
+  if (invalidated) {
+    photo_loader.cancel();
+    for (Photo &photo : photos) {
+      photo.requested_level = -1;
+    }
+  }
 }
 
 void handle_clay_errors(Clay_ErrorData errorData) {
@@ -377,9 +393,13 @@ void handle_photo_item_interaction(Clay_ElementId elementId,
                                    Clay_PointerData pointerInfo,
                                    intptr_t userData) {
   Photo *photo = (Photo *)userData;
+  hovered_photo = photo;
   // Pointer state allows you to detect mouse down / hold / release
   if (pointerInfo.state == CLAY_POINTER_DATA_PRESSED_THIS_FRAME) {
-    photo->selected = !photo->selected;
+    size_t index = photo - photos.data();
+    bool selected = !photo_selection.test(index);
+    photo_selection.set(index, selected);
+    selection_sidecar.set_selected(photo->selection_id, selected);
     // Do some click handling
     // NavigateTo(buttonData->link);
   }
@@ -389,9 +409,20 @@ void handle_finalize_button_interaction(Clay_ElementId elementId,
                                         Clay_PointerData pointerInfo,
                                         intptr_t userData) {
   if (pointerInfo.state == CLAY_POINTER_DATA_PRESSED_THIS_FRAME) {
-    seperate_photos(photos);
+    // One batch at a time
+    if (photo_mover.is_busy()) {
+      return;
+    }
+    folder_watcher.stop();
+    directory_scanner.cancel();
+    loupe_view.close(renderer);
+    photo_loader.cancel();
+    seperate_photos(photos, photos_root_path);
+    selection_sidecar.remove();
     folder_opened = false;
+    unload_photo_textures();
     photos.clear();
+    photo_selection.clear();
   }
 }
 
@@ -432,7 +463,7 @@ void handle_filters_button_interaction(Clay_ElementId elementId,
 }
 
 // TODO: Change hover to full photo rect, current selection is too small
-inline void PhotoItem(Photo &photo) {
+inline void PhotoItem(Photo &photo, int index, bool selected) {
   uint16_t corner_radius = 16;
   uint16_t checkbox_corner_radius = 5;
   CLAY({
@@ -450,7 +481,7 @@ inline void PhotoItem(Photo &photo) {
               .layoutDirection = CLAY_TOP_TO_BOTTOM,
           },
       .backgroundColor =
-          photo.selected ? COLOR_SELECTED_GREEN : COLOR_PURE_WHITE,
+          selected ? COLOR_SELECTED_GREEN : COLOR_PURE_WHITE,
       .cornerRadius = CLAY_CORNER_RADIUS(static_cast<float>(corner_radius)),
       .image =
           {
@@ -470,6 +501,7 @@ inline void PhotoItem(Photo &photo) {
   }) {
     Clay_OnHover(handle_photo_item_interaction, (intptr_t)&photo);
     CLAY({
+        .id = CLAY_IDI("PhotoImage", index),
         .layout =
             {
                 .sizing = {.width = CLAY_SIZING_GROW(0),
@@ -477,7 +509,9 @@ inline void PhotoItem(Photo &photo) {
                 .padding = CLAY_PADDING_ALL(static_cast<uint16_t>(
                     corner_radius - 3 - checkbox_corner_radius)),
             },
-        .backgroundColor = COLOR_PURE_WHITE,
+        // Placeholder until the loader uploads the thumbnail
+        .backgroundColor =
+            photo.loaded_levels ? COLOR_PURE_WHITE : COLOR_DARK_GREY,
         .cornerRadius =
             CLAY_CORNER_RADIUS(static_cast<float>(corner_radius - 3)),
         .aspectRatio =
@@ -486,7 +520,9 @@ inline void PhotoItem(Photo &photo) {
             },
         .image =
             {
-                .imageData = static_cast<void *>(&photo.image_data),
+                .imageData = photo.loaded_levels
+                                 ? static_cast<void *>(&photo.image_data)
+                                 : nullptr,
             },
     }) {
       CLAY({
@@ -510,7 +546,7 @@ inline void PhotoItem(Photo &photo) {
                   .padding = CLAY_PADDING_ALL(3),
               },
           .backgroundColor =
-              photo.selected ? COLOR_SELECTED_GREEN : COLOR_PURE_WHITE,
+              selected ? COLOR_SELECTED_GREEN : COLOR_PURE_WHITE,
           .cornerRadius =
               CLAY_CORNER_RADIUS(static_cast<float>(checkbox_corner_radius)),
           .image =
@@ -556,7 +592,7 @@ inline void PhotoItem(Photo &photo) {
                           },
                   },
               .backgroundColor =
-                  photo.selected ? COLOR_SELECTED_GREEN : COLOR_TRANSPARENT,
+                  selected ? COLOR_SELECTED_GREEN : COLOR_TRANSPARENT,
               .image =
                   {
                       .imageData = static_cast<void *>(&check_data),
@@ -568,12 +604,130 @@ inline void PhotoItem(Photo &photo) {
   }
 }
 
-void PhotoGrid(std::vector<Photo> &photos, int image_minimum_width) {
-  // Photo grid calculation
-  int image_counter = 0;
-  int photo_columns = renderer.width / image_minimum_width;
+int photo_grid_columns(int image_minimum_width) {
+  return SDL_max(static_cast<int>(renderer.width) / image_minimum_width, 1);
+}
 
+// Works out which rows end up inside the grid's scroll container, using the
+// scroll offset and row size Clay computed last frame
+void update_photo_grid_view(int num_rows, float layout_width) {
+  const float padding = 8.0f;
+  const float gap = 4.0f;
+  PhotoGridView &view = photo_grid_view;
+
+  Clay_ScrollContainerData scroll_data =
+      Clay_GetScrollContainerData(CLAY_ID("PhotoGrid"));
+  Clay_ElementData row_data =
+      Clay_GetElementData(CLAY_IDI("PhotoRow", view.first_row));
+  Clay_ElementData image_data = Clay_GetElementData(
+      CLAY_IDI("PhotoImage", view.first_row * view.columns));
+  // Used until something is measured, from the cell width and 3:2 photos
+  float cell_width =
+      (layout_width - 2 * padding - gap * (view.columns - 1)) / view.columns;
+  if (row_data.found && row_data.boundingBox.height > 0.0f) {
+    view.row_height = row_data.boundingBox.height;
+  } else {
+    view.row_height = SDL_max((cell_width - 6.0f) * 2.0f / 3.0f + 6.0f, 1.0f);
+  }
+  if (image_data.found && image_data.boundingBox.width > 0.0f) {
+    view.image_width = image_data.boundingBox.width;
+  } else {
+    view.image_width = SDL_max(cell_width - 6.0f, 1.0f);
+  }
+
+  float scroll = 0.0f;
+  float viewport_height = 0.0f;
+  if (scroll_data.found) {
+    scroll = -scroll_data.scrollPosition->y;
+    viewport_height = scroll_data.scrollContainerDimensions.height;
+  }
+  if (scroll != view.scroll) {
+    view.scroll_direction = scroll > view.scroll ? 1 : -1;
+    view.scroll = scroll;
+  }
+
+  float row_stride = view.row_height + gap;
+  int first_row = static_cast<int>(std::floor((scroll - padding) / row_stride));
+  int last_row = static_cast<int>(
+      std::ceil((scroll + viewport_height - padding) / row_stride));
+  if (num_rows == 0) {
+    view.first_row = 0;
+    view.last_row = 0;
+    return;
+  }
+  // At least one row so there is something to measure
+  view.first_row = SDL_clamp(first_row, 0, num_rows - 1);
+  view.last_row = SDL_clamp(last_row, view.first_row + 1, num_rows);
+}
+
+// Queues the visible photos first, then the prefetch rows ahead of the
+// scroll. Jobs that scrolled out of range before a worker got to them are
+// dropped so fast scrolling doesn't leave a backlog of offscreen decodes.
+void request_visible_thumbnails() {
+  const PhotoGridView &view = photo_grid_view;
+  if (photos.empty()) {
+    return;
+  }
+
+  int first_row = view.first_row;
+  int last_row = view.last_row;
+  if (view.scroll_direction > 0) {
+    last_row += thumbnail_prefetch_rows;
+  } else {
+    first_row -= thumbnail_prefetch_rows;
+  }
+  size_t begin = static_cast<size_t>(SDL_max(first_row, 0)) * view.columns;
+  size_t end = SDL_min(static_cast<size_t>(last_row) * view.columns,
+                       photos.size());
+  size_t visible_begin = static_cast<size_t>(view.first_row) * view.columns;
+  size_t visible_end = SDL_min(static_cast<size_t>(view.last_row) * view.columns,
+                               photos.size());
+
+  dropped_thumbnail_requests.clear();
+  photo_loader.drop_pending_outside(begin, end, dropped_thumbnail_requests);
+  for (size_t index : dropped_thumbnail_requests) {
+    photos[index].requested_level = -1;
+  }
+
+  // One request in flight per photo, a level change waits for it to land
+  int level = view.level;
+  auto request = [level](size_t index, bool visible) {
+    Photo &photo = photos[index];
+    if (photo.requested_level < 0 && !(photo.loaded_levels & (1u << level)) &&
+        photo.failed_requests < thumbnail_max_attempts) {
+      photo.requested_level = level;
+      photo_loader.enqueue(index, level, photo.file_path);
+      if (visible) {
+        thumbnail_residency.count_miss();
+      }
+    }
+  };
+  for (size_t i = visible_begin; i < visible_end; i++) {
+    request(i, true);
+  }
+  for (size_t i = begin; i < end; i++) {
+    request(i, false);
+  }
+}
+
+// Rows outside the visible range are collapsed into two spacers, so layout
+// cost only depends on the window size and not on how many photos there are
+void PhotoGrid(std::vector<Photo> &photos, int image_minimum_width,
+               float layout_width) {
+  const float gap = 4.0f;
+  int photo_columns = photo_grid_columns(image_minimum_width);
   int num_images = std::size(photos);
+  int num_rows = (num_images + photo_columns - 1) / photo_columns;
+
+  photo_grid_view.columns = photo_columns;
+  update_photo_grid_view(num_rows, layout_width);
+  // Same pick draw_texture_rect makes for the measured image element
+  photo_grid_view.level = renderer.texture_level(
+      thumbnail_level_widths, thumbnail_level_count,
+      (1u << thumbnail_level_count) - 1, photo_grid_view.image_width);
+  const PhotoGridView &view = photo_grid_view;
+  float row_stride = view.row_height + gap;
+
   CLAY({
       .id = CLAY_ID("PhotoGrid"),
       .layout =
@@ -602,21 +756,42 @@ void PhotoGrid(std::vector<Photo> &photos, int image_minimum_width) {
                         .height = CLAY_SIZING_GROW(0),
                     },
                 .padding = CLAY_PADDING_ALL(8),
-                .childGap = 4,
+                .childGap = static_cast<uint16_t>(gap),
                 .layoutDirection = CLAY_TOP_TO_BOTTOM,
             },
     }) {
-      for (int i = 0; i < 16 && image_counter < num_images; i++) {
-        CLAY({.layout = {
+      // The gap after a spacer stands in for the gap after its last row
+      if (view.first_row > 0) {
+        CLAY({
+            .layout =
+                {
+                    .sizing = {.width = CLAY_SIZING_GROW(0),
+                               .height = CLAY_SIZING_FIXED(
+                                   view.first_row * row_stride - gap)},
+                },
+        }) {}
+      }
+      for (int row = view.first_row; row < view.last_row; row++) {
+        CLAY({.id = CLAY_IDI("PhotoRow", row),
+              .layout = {
                   .sizing = {.width = CLAY_SIZING_GROW(0),
                              .height = CLAY_SIZING_FIT(0)},
-                  .childGap = 4,
+                  .childGap = static_cast<uint16_t>(gap),
                   .layoutDirection = CLAY_LEFT_TO_RIGHT,
               }}) {
           for (int i = 0; i < photo_columns; i++) {
-            if (image_counter < num_images) {
-              PhotoItem(photos[image_counter]);
-              image_counter++;
+            int image_index = row * photo_columns + i;
+            if (image_index < num_images) {
+              // Same pick the renderer makes, so the level that gets drawn
+              // counts as used
+              int level = renderer.texture_level(
+                  thumbnail_level_widths, thumbnail_level_count,
+                  photos[image_index].loaded_levels, view.image_width);
+              thumbnail_residency.touch(
+                  thumbnail_residency_key(image_index,
+                                          level < 0 ? view.level : level));
+              PhotoItem(photos[image_index], image_index,
+                        photo_selection.test(image_index));
             } else {
               CLAY({
                   .layout =
@@ -629,6 +804,17 @@ void PhotoGrid(std::vector<Photo> &photos, int image_minimum_width) {
           }
         }
       }
+      if (view.last_row < num_rows) {
+        CLAY({
+            .layout =
+                {
+                    .sizing = {.width = CLAY_SIZING_GROW(0),
+                               .height = CLAY_SIZING_FIXED(
+                                   (num_rows - view.last_row) * row_stride -
+                                   gap)},
+                },
+        }) {}
+      }
     }
   }
 }
@@ -811,6 +997,39 @@ void Tally(Clay_String label) {
   }
 }
 
+// Plain text the height of a button, so the bar doesn't change size
+void ProgressLabel(Clay_String label) {
+  uint16_t label_height = 48;
+  CLAY({
+      .layout =
+          {
+              .sizing =
+                  {
+                      .width = CLAY_SIZING_FIT(0),
+                      .height = CLAY_SIZING_FIXED(
+                          static_cast<float>(label_height)),
+                  },
+              .padding =
+                  {
+                      .left = 16,
+                      .right = 16,
+                      .top = 0,
+                      .bottom = 0,
+                  },
+              .childAlignment =
+                  {
+                      .y = CLAY_ALIGN_Y_CENTER,
+                  },
+          },
+  }) {
+    CLAY_TEXT(label, CLAY_TEXT_CONFIG({
+                         .textColor = COLOR_PURE_WHITE,
+                         .fontSize = 20,
+                         .wrapMode = CLAY_TEXT_WRAP_NONE,
+                     }));
+  }
+}
+
 void BottomBar() {
   float bottom_bar_corner_radius = 38.0f;
   CLAY({
@@ -941,7 +1160,14 @@ void BottomBar() {
                       },
               },
       }) {
-        Button(CLAY_STRING("Finalize"), handle_finalize_button_interaction);
+        if (photo_mover.is_busy()) {
+          ProgressLabel(Clay_String{
+              .length = static_cast<int32_t>(finalize_label.length()),
+              .chars = finalize_label.c_str(),
+          });
+        } else {
+          Button(CLAY_STRING("Finalize"), handle_finalize_button_interaction);
+        }
       }
       // Right Align
       CLAY({
@@ -969,14 +1195,15 @@ void BottomBar() {
 static inline Clay_Dimensions MeasureText(Clay_StringSlice text,
                                           Clay_TextElementConfig *config,
                                           void *userData) {
-  float scalar = config->fontSize / renderer.font_sample_point_size;
-  return Clay_Dimensions{.width = (float)text.length * renderer.glyph_size.x *
-                                  scalar,
-                         .height = (float)renderer.glyph_size.y * scalar};
+  glm::vec2 size = renderer.measure_text(text.chars, text.length,
+                                         config->fontSize, config->fontId);
+  return Clay_Dimensions{.width = size.x, .height = size.y};
 }
 
 bool init() {
   renderer.init();
+  photo_loader.start();
+  loupe_view.start(loupe_worker_count);
 
   std::vector<std::string> loaded_sprite_paths;
   for (auto &[entity_id, sprite_component] : sprite_components) {
@@ -1004,6 +1231,13 @@ bool init() {
 bool loop() { return true; }
 
 bool cleanup() {
+  folder_watcher.stop();
+  directory_scanner.cancel();
+  photo_loader.stop();
+  // Never leave a photo half moved
+  photo_mover.wait();
+  selection_sidecar.close();
+  loupe_view.stop();
   renderer.cleanup();
   return true;
 }
@@ -1046,6 +1280,14 @@ int main(int argc, char *argv[]) {
     return 1;
   }
 
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--bench-quads") == 0) {
+      bool finished = QuadBench::run(renderer);
+      cleanup();
+      return finished ? 0 : 1;
+    }
+  }
+
   uint64_t total_memory_size = Clay_MinMemorySize();
   Clay_Arena clay_memory = Clay_CreateArenaWithCapacityAndMemory(
       total_memory_size, malloc(total_memory_size));
@@ -1124,6 +1366,19 @@ int main(int argc, char *argv[]) {
       ++physics_frame_count;
       if (physics_frame_count >= static_cast<int>(physics_tick_rate)) {
         SDL_Log("FPS: %d", static_cast<int>(process_frame_count));
+        const TextureResidency::Stats &stats = thumbnail_residency.get_stats();
+        SDL_Log("Thumbnails: %zu resident (%zu MiB), %llu hits, %llu misses, "
+                "%llu evictions",
+                stats.resident_count, stats.resident_bytes / (1024 * 1024),
+                (unsigned long long)stats.hits,
+                (unsigned long long)stats.misses,
+                (unsigned long long)stats.evictions);
+        const RenderStats &render_stats = renderer.get_frame_stats();
+        SDL_Log("Render: %u commands, %u draws, %u pipeline binds, "
+                "%u sampler binds, %u uniform pushes, %u scissor changes",
+                render_stats.commands, render_stats.draws,
+                render_stats.pipeline_binds, render_stats.sampler_binds,
+                render_stats.uniform_pushes, render_stats.scissor_changes);
         physics_frame_count = 0;
         process_frame_count = 0;
       }
@@ -1143,12 +1398,34 @@ int main(int argc, char *argv[]) {
         mouse_position.x = event.wheel.mouse_x;
         mouse_position.y = event.wheel.mouse_y;
 
+        if (loupe_view.is_open()) {
+          loupe_view.pan(glm::vec2(-event.wheel.x, -event.wheel.y) * 64.0f *
+                         renderer.viewport_scale);
+          break;
+        }
         mouse_scroll.x = event.wheel.x * scroll_speed / renderer.viewport_scale;
         mouse_scroll.y = event.wheel.y * scroll_speed / renderer.viewport_scale;
         break;
       case SDL_EVENT_MOUSE_MOTION:
         mouse_position.x = event.motion.x;
         mouse_position.y = event.motion.y;
+        // Drag the photo around in the loupe
+        if (loupe_view.is_open() && is_mouse_down) {
+          loupe_view.pan(glm::vec2(-event.motion.xrel, -event.motion.yrel) *
+                         renderer.viewport_scale);
+        }
+        break;
+      case SDL_EVENT_KEY_DOWN:
+        // Space opens the hovered photo at 100%, space or escape close it
+        if (event.key.key == SDLK_SPACE && !event.key.repeat) {
+          if (loupe_view.is_open()) {
+            loupe_view.close(renderer);
+          } else if (hovered_photo) {
+            loupe_view.open(renderer, hovered_photo->file_path);
+          }
+        } else if (event.key.key == SDLK_ESCAPE) {
+          loupe_view.close(renderer);
+        }
         break;
       case SDL_EVENT_MOUSE_BUTTON_DOWN:
         is_mouse_down = true;
@@ -1162,15 +1439,43 @@ int main(int argc, char *argv[]) {
     TransformComponent &cursor_transform = transform_components[amogus];
     cursor_transform.position = glm::vec2(mouse_position.x, mouse_position.y);
 
-    // Get tally count
-    // This is technically a bit redundant
-    // but is guaranteed to not be out of sync
-    std::stringstream ss;
-    ss << get_selected_photos_count();
-    tally_label = ss.str();
+    // Only reformatted when the count actually changed
+    if (photo_selection.count() != tally_count) {
+      tally_count = photo_selection.count();
+      tally_label = std::to_string(tally_count);
+    }
+
+    add_scanned_photos();
+    apply_folder_events();
+    if (photo_mover.is_busy()) {
+      update_finalize_label();
+    }
+    selection_sidecar.sync_if_due();
+
+    // Stream in whatever the loader finished decoding since last frame
+    thumbnail_residency.begin_frame();
+    for (const LoadedThumbnail &loaded :
+         photo_loader.upload_ready(renderer, thumbnail_uploads_per_frame)) {
+      if (loaded.index < photos.size()) {
+        Photo &photo = photos[loaded.index];
+        if (photo.requested_level == loaded.level) {
+          photo.requested_level = -1;
+        }
+        // Asked for again next frame, until it runs out of attempts
+        if (loaded.failed) {
+          photo.failed_requests++;
+          continue;
+        }
+        photo.loaded_levels |= 1u << loaded.level;
+        thumbnail_residency.add(
+            thumbnail_residency_key(loaded.index, loaded.level), loaded.bytes);
+      }
+    }
 
     renderer.begin_frame(); // Start here to update window dimensions for clay
 
+    int image_minimum_width = 240 * renderer.viewport_scale;
+
     // Clay foreplay
     Clay_Dimensions clay_dimensions = {
         .width = static_cast<float>(renderer.width) / renderer.viewport_scale,
@@ -1181,11 +1486,17 @@ int main(int argc, char *argv[]) {
         Clay_GetElementData(CLAY_ID("BottomBar")).boundingBox.height;
 
     Clay_SetLayoutDimensions(clay_dimensions);
-    Clay_SetPointerState(mouse_position, is_mouse_down);
+    // The loupe covers the UI, keep clicks from going through to the grid
+    if (loupe_view.is_open()) {
+      Clay_SetPointerState(Clay_Vector2{-1.0f, -1.0f}, false);
+    } else {
+      Clay_SetPointerState(mouse_position, is_mouse_down);
+    }
     Clay_UpdateScrollContainers(enable_drag_scrolling, mouse_scroll,
                                 process_delta_time);
 
     // Clay UI
+    hovered_photo = nullptr;
     Clay_BeginLayout();
     CLAY({
         .id = CLAY_ID("Root"),
@@ -1221,7 +1532,7 @@ int main(int argc, char *argv[]) {
       }) {
         // Image Grid
         if (folder_opened) {
-          PhotoGrid(photos, 240 * renderer.viewport_scale);
+          PhotoGrid(photos, image_minimum_width, clay_dimensions.width);
         } else {
           Placeholder();
         }
@@ -1242,23 +1553,31 @@ int main(int argc, char *argv[]) {
     }
     Clay_RenderCommandArray render_commands = Clay_EndLayout();
 
-    // TODO: Anything outside of renderer should first collate commands
-    // This should allow for unloaded sprites to be identified, allowing
-    // renderer to load them in first before trying to render them, instead
-    // of rendering them on the next frame.
-    //
-    // This should also help if there are many draw calls, and it also
-    // should facilitate objects which use the same resources
-    //
-    // Best implementation of these would make the draw_X commands internal,
-    // and instead provide an exposed "draw" function that instead
-    // adds the draw command to a staging array.
+    // Only thumbnails that weren't drawn this frame get evicted, so none of
+    // the render commands above can point at a released texture
+    evicted_thumbnails.clear();
+    thumbnail_residency.evict(evicted_thumbnails);
+    for (size_t key : evicted_thumbnails) {
+      Photo &photo = photos[key / thumbnail_level_count];
+      int level = key % thumbnail_level_count;
+      renderer.destroy_texture_level(photo.image_data.path, level);
+      photo.loaded_levels &= ~(1u << level);
+    }
+
+    if (folder_opened) {
+      request_visible_thumbnails();
+    }
+
+    // TODO: Draws are queued until end_frame now, unloaded sprites could be
+    // identified from the queue and loaded in first before trying to render
+    // them, instead of rendering them on the next frame.
 
     // TODO: Clay renderer should have an id: data unordered map to allow
     // for basic animations like css
     // Would also probably need to make a Tween class or just lerp it.
 
     ClayRenderer::render_commands(renderer, render_commands);
+    loupe_view.draw(renderer);
     SpriteSystem::draw_all(renderer);
     renderer.end_frame();
   }
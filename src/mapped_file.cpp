@@ -0,0 +1,183 @@
+#include "mapped_file.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#include "SDL3/SDL_log.h"
+
+#include "config.hpp"
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <ctime>
+#endif
+
+MappedFile::~MappedFile() { close(); }
+
+bool MappedFile::open(const std::filesystem::path &path,
+                      std::vector<uint8_t> *scratch) {
+  return open_file(path, scratch, false);
+}
+
+bool MappedFile::open_stable(const std::filesystem::path &path) {
+  return open_file(path, nullptr, true);
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open_file(const std::filesystem::path &path,
+                           std::vector<uint8_t> *scratch, bool stable) {
+  close();
+  std::ifstream stream(path, std::ios::binary | std::ios::ate);
+  if (!stream.is_open()) {
+    return false;
+  }
+  std::streampos size = stream.tellg();
+  if (size <= 0) {
+    return false;
+  }
+  std::vector<uint8_t> &buffer = scratch ? *scratch : fallback_buffer;
+  buffer.resize(static_cast<size_t>(size));
+  stream.seekg(0, std::ios::beg);
+  stream.read(reinterpret_cast<char *>(buffer.data()), size);
+  mapped_data = buffer.data();
+  mapped_size = buffer.size();
+  return true;
+}
+
+void MappedFile::close() {
+  fallback_buffer.clear();
+  fallback_buffer.shrink_to_fit();
+  mapped_data = nullptr;
+  mapped_size = 0;
+}
+
+void MappedFile::advise_random() {}
+
+void MappedFile::advise_sequential() {}
+
+void MappedFile::prefetch(size_t offset, size_t length) {}
+
+#else
+
+// Reads up to size bytes from the start of the file, fewer if it got
+// truncated meanwhile
+static bool read_file(int fd, size_t size, std::vector<uint8_t> &buffer) {
+  buffer.resize(size);
+  size_t done = 0;
+  while (done < size) {
+    ssize_t result = pread(fd, buffer.data() + done, size - done,
+                           static_cast<off_t>(done));
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result < 0) {
+      return false;
+    }
+    if (result == 0) {
+      break;
+    }
+    done += static_cast<size_t>(result);
+  }
+  buffer.resize(done);
+  return done > 0;
+}
+
+bool MappedFile::open_file(const std::filesystem::path &path,
+                           std::vector<uint8_t> *scratch, bool stable) {
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    SDL_Log("ERROR: opening %s: %s", path.c_str(), strerror(errno));
+    return false;
+  }
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) < 0 || file_stat.st_size <= 0) {
+    ::close(fd);
+    return false;
+  }
+
+  // A file that hasn't changed in a while is taken to be complete. One
+  // rewritten in place later on can still fault.
+  if (stable ||
+      time(nullptr) - file_stat.st_mtime >= mapped_file_settle_seconds) {
+    void *address = mmap(nullptr, static_cast<size_t>(file_stat.st_size),
+                         PROT_READ, MAP_PRIVATE, fd, 0);
+    if (address == MAP_FAILED) {
+      SDL_Log("ERROR: mapping %s: %s", path.c_str(), strerror(errno));
+      ::close(fd);
+      return false;
+    }
+    // Changed while it was being mapped, so it's being written after all
+    struct stat mapped_stat;
+    if (stable || (fstat(fd, &mapped_stat) == 0 &&
+                   mapped_stat.st_size == file_stat.st_size &&
+                   mapped_stat.st_mtime == file_stat.st_mtime)) {
+      // The mapping keeps its own reference to the file
+      ::close(fd);
+      mapped_data = static_cast<uint8_t *>(address);
+      mapped_size = static_cast<size_t>(file_stat.st_size);
+      mapped = true;
+      return true;
+    }
+    munmap(address, static_cast<size_t>(file_stat.st_size));
+    file_stat = mapped_stat;
+  }
+
+  // Reading copies whatever is there now, later writes can't reach it
+  std::vector<uint8_t> &buffer = scratch ? *scratch : fallback_buffer;
+  bool read = file_stat.st_size > 0 &&
+              read_file(fd, static_cast<size_t>(file_stat.st_size), buffer);
+  ::close(fd);
+  if (!read) {
+    SDL_Log("ERROR: reading %s: %s", path.c_str(), strerror(errno));
+    return false;
+  }
+  mapped_data = buffer.data();
+  mapped_size = buffer.size();
+  return true;
+}
+
+void MappedFile::close() {
+  if (mapped) {
+    munmap(mapped_data, mapped_size);
+  }
+  fallback_buffer.clear();
+  fallback_buffer.shrink_to_fit();
+  mapped_data = nullptr;
+  mapped_size = 0;
+  mapped = false;
+}
+
+void MappedFile::advise_random() {
+  if (mapped) {
+    madvise(mapped_data, mapped_size, MADV_RANDOM);
+  }
+}
+
+void MappedFile::advise_sequential() {
+  if (mapped) {
+    madvise(mapped_data, mapped_size, MADV_SEQUENTIAL);
+  }
+}
+
+void MappedFile::prefetch(size_t offset, size_t length) {
+  if (!mapped || offset >= mapped_size) {
+    return;
+  }
+  // madvise wants a page aligned start
+  static const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t aligned_offset = offset / page_size * page_size;
+  length = SDL_min(length + (offset - aligned_offset),
+                   mapped_size - aligned_offset);
+  madvise(mapped_data + aligned_offset, length, MADV_WILLNEED);
+}
+
+#endif
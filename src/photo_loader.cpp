@@ -0,0 +1,273 @@
+#include "photo_loader.hpp"
+
+#include "SDL3/SDL_log.h"
+
+#include "config.hpp"
+#include "jpeg_decoder.hpp"
+
+PhotoLoader::PhotoLoader() : results(thumbnail_queue_capacity) {}
+
+PhotoLoader::~PhotoLoader() { stop(); }
+
+bool PhotoLoader::start(unsigned int worker_count) {
+  if (running) {
+    return true;
+  }
+  if (worker_count == 0) {
+    worker_count = SDL_max(std::thread::hardware_concurrency(), 1u);
+  }
+
+  running = true;
+  results.reopen();
+  for (unsigned int i = 0; i < worker_count; i++) {
+    workers.emplace_back(&PhotoLoader::worker_main, this);
+  }
+  SDL_Log("Photo loader started with %u workers", worker_count);
+  return true;
+}
+
+void PhotoLoader::stop() {
+  {
+    std::lock_guard<std::mutex> lock(jobs_mutex);
+    if (!running) {
+      return;
+    }
+    running = false;
+    jobs.clear();
+  }
+  jobs_available.notify_all();
+  results.close(); // Unblocks workers waiting for room
+
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  workers.clear();
+  results.clear();
+  cache.close();
+}
+
+bool PhotoLoader::open_cache(const std::filesystem::path &folder) {
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  if (!cache.open(folder)) {
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> jobs_lock(jobs_mutex);
+    prune_cache = true;
+  }
+  jobs_available.notify_one();
+  return true;
+}
+
+void PhotoLoader::enqueue(size_t index, int level,
+                          std::filesystem::path file_path) {
+  {
+    std::lock_guard<std::mutex> lock(jobs_mutex);
+    jobs.push_back(ThumbnailJob{
+        .index = index,
+        .level = level,
+        .generation = generation,
+        .file_path = std::move(file_path),
+    });
+  }
+  jobs_available.notify_one();
+}
+
+void PhotoLoader::cancel() {
+  {
+    std::lock_guard<std::mutex> lock(jobs_mutex);
+    jobs.clear();
+    // Anything still being decoded is tagged with the old generation and gets
+    // dropped in upload_ready()
+    generation++;
+  }
+  // Finished results hand their buffers back for the next folder's decodes
+  ThumbnailResult result;
+  while (results.try_pop(result)) {
+    recycle_pixel_buffer(std::move(result.thumbnail.pixels));
+    cache.release(result.cached);
+  }
+}
+
+void PhotoLoader::drop_pending_outside(size_t begin, size_t end,
+                                       std::vector<size_t> &dropped) {
+  std::lock_guard<std::mutex> lock(jobs_mutex);
+  auto kept = jobs.begin();
+  for (auto it = jobs.begin(); it != jobs.end(); ++it) {
+    if (it->index >= begin && it->index < end) {
+      if (kept != it) {
+        *kept = std::move(*it);
+      }
+      ++kept;
+    } else {
+      dropped.push_back(it->index);
+    }
+  }
+  jobs.erase(kept, jobs.end());
+}
+
+const std::vector<LoadedThumbnail> &
+PhotoLoader::upload_ready(Renderer &renderer, size_t max_uploads) {
+  for (ThumbnailResult &item : ready) {
+    recycle_pixel_buffer(std::move(item.thumbnail.pixels));
+    cache.release(item.cached);
+  }
+  ready.clear();
+  uploads.clear();
+  loaded.clear();
+
+  ThumbnailResult result;
+  while (ready.size() < max_uploads && results.try_pop(result)) {
+    if (result.generation != generation) {
+      recycle_pixel_buffer(std::move(result.thumbnail.pixels));
+      cache.release(result.cached);
+      continue;
+    }
+    ready.push_back(std::move(result));
+  }
+  if (ready.empty()) {
+    return loaded;
+  }
+
+  for (ThumbnailResult &item : ready) {
+    if (item.failed) {
+      failed.push_back(LoadedThumbnail{
+          .index = item.index,
+          .level = item.level,
+          .bytes = 0,
+          .failed = true,
+      });
+      continue;
+    }
+    if (item.cached.pixels) {
+      uploads.push_back(TextureUpload{
+          .path = item.file_path.string(),
+          .level = item.level,
+          .width = item.cached.width,
+          .height = item.cached.height,
+          .pixels = item.cached.pixels,
+      });
+    } else {
+      uploads.push_back(TextureUpload{
+          .path = item.file_path.string(),
+          .level = item.level,
+          .width = item.thumbnail.width,
+          .height = item.thumbnail.height,
+          .pixels = item.thumbnail.pixels.data(),
+      });
+    }
+    const TextureUpload &upload = uploads.back();
+    loaded.push_back(LoadedThumbnail{
+        .index = item.index,
+        .level = item.level,
+        .bytes = size_t(upload.width) * upload.height * 4,
+        .failed = false,
+    });
+  }
+
+  if (!uploads.empty() && !renderer.load_textures(uploads)) {
+    SDL_Log("Failed to upload %zu thumbnails", uploads.size());
+    for (LoadedThumbnail &item : loaded) {
+      item.failed = true;
+    }
+  }
+  loaded.insert(loaded.end(), failed.begin(), failed.end());
+  failed.clear();
+  return loaded;
+}
+
+std::vector<uint8_t> PhotoLoader::take_pixel_buffer() {
+  std::lock_guard<std::mutex> lock(spare_pixel_buffers_mutex);
+  if (spare_pixel_buffers.empty()) {
+    return {};
+  }
+  std::vector<uint8_t> buffer = std::move(spare_pixel_buffers.back());
+  spare_pixel_buffers.pop_back();
+  return buffer;
+}
+
+void PhotoLoader::recycle_pixel_buffer(std::vector<uint8_t> &&buffer) {
+  if (buffer.capacity() == 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(spare_pixel_buffers_mutex);
+  spare_pixel_buffers.push_back(std::move(buffer));
+}
+
+bool PhotoLoader::is_idle() {
+  std::lock_guard<std::mutex> lock(jobs_mutex);
+  return jobs.empty() && busy_workers == 0 && results.size() == 0;
+}
+
+void PhotoLoader::worker_main() {
+  // Lives as long as the worker, keeps its TurboJPEG handle and scratch
+  // buffers between photos
+  JpegDecoder decoder;
+
+  while (true) {
+    ThumbnailResult result;
+    result.failed = false;
+    {
+      std::unique_lock<std::mutex> lock(jobs_mutex);
+      jobs_available.wait(lock, [this] {
+        return !running || !jobs.empty() || prune_cache;
+      });
+      if (!running) {
+        return;
+      }
+      if (jobs.empty()) {
+        // Nothing to decode, look for thumbnails of deleted photos meanwhile.
+        // Stops on a folder switch or shutdown.
+        prune_cache = false;
+        uint32_t started = generation;
+        lock.unlock();
+        cache.prune([this, started] {
+          std::lock_guard<std::mutex> lock(jobs_mutex);
+          return running && generation == started;
+        });
+        continue;
+      }
+      ThumbnailJob &job = jobs.front();
+      result.index = job.index;
+      result.level = job.level;
+      result.generation = job.generation;
+      result.file_path = std::move(job.file_path);
+      jobs.pop_front();
+      busy_workers++;
+    }
+
+    bool decoded = false;
+    bool current = result.generation == generation;
+    if (current) {
+      int width = thumbnail_level_widths[result.level];
+      FileStamp stamp;
+      bool has_stamp = ThumbnailCache::get_stamp(result.file_path, stamp);
+      if (has_stamp &&
+          cache.lookup(result.file_path, width, stamp, result.cached)) {
+        decoded = true;
+      } else {
+        result.thumbnail.pixels = take_pixel_buffer();
+        decoded = decoder.decode_thumbnail(result.file_path, width,
+                                           result.thumbnail);
+        if (decoded && has_stamp) {
+          // Cancelled by a folder switch, this isn't the photo's cache anymore
+          std::lock_guard<std::mutex> lock(cache_mutex);
+          if (result.generation == generation) {
+            cache.store(result.file_path, width, stamp, result.thumbnail);
+          }
+        }
+      }
+    }
+    if (decoded) {
+      results.push(std::move(result));
+    } else {
+      recycle_pixel_buffer(std::move(result.thumbnail.pixels));
+      // So the grid stops waiting for it
+      if (current) {
+        result.failed = true;
+        results.push(std::move(result));
+      }
+    }
+    busy_workers--;
+  }
+}
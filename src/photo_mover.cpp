@@ -0,0 +1,203 @@
+#include "photo_mover.hpp"
+
+#include <string>
+#include <system_error>
+#include <unordered_set>
+
+#include "SDL3/SDL_log.h"
+
+#include "copy_engine.hpp"
+
+// Appends -number to the stem, IMG_0001.JPG becomes IMG_0001-2.JPG
+static std::filesystem::path numbered(const std::filesystem::path &path,
+                                      int number) {
+  if (number == 0) {
+    return path;
+  }
+  std::filesystem::path name = path.stem();
+  name += "-" + std::to_string(number);
+  name += path.extension();
+  return path.parent_path() / name;
+}
+
+// Photos from different DCF folders (100CANON and 101CANON after the file
+// counter wraps, or two bodies) often share a name, and so can leftovers in
+// the destination. Every file of a RAW+JPEG pair gets the same number so the
+// pair still matches.
+static void number_collisions(std::vector<FileMove> &moves) {
+  std::unordered_set<std::string> claimed;
+  size_t first = 0;
+  while (first < moves.size()) {
+    // A pair's files are next to each other with the same folder and stem
+    size_t last = first + 1;
+    while (last < moves.size() &&
+           moves[last].from.parent_path() == moves[first].from.parent_path() &&
+           moves[last].from.stem() == moves[first].from.stem()) {
+      last++;
+    }
+    auto taken = [&](int number) {
+      for (size_t i = first; i < last; i++) {
+        std::filesystem::path to = numbered(moves[i].to, number);
+        std::error_code error;
+        if (claimed.contains(to.string()) ||
+            std::filesystem::exists(to, error)) {
+          return true;
+        }
+      }
+      return false;
+    };
+    int number = 0;
+    while (taken(number)) {
+      number++;
+    }
+    for (size_t i = first; i < last; i++) {
+      if (number > 0) {
+        SDL_Log("%s is taken, moving %s there as %s",
+                moves[i].to.string().c_str(),
+                moves[i].from.string().c_str(),
+                numbered(moves[i].to, number).filename().string().c_str());
+      }
+      moves[i].to = numbered(moves[i].to, number);
+      claimed.insert(moves[i].to.string());
+    }
+    first = last;
+  }
+}
+
+PhotoMover::~PhotoMover() { wait(); }
+
+bool PhotoMover::start(std::vector<FileMove> moves,
+                       const std::filesystem::path &journal_path,
+                       bool resumed) {
+  if (busy) {
+    return false;
+  }
+  wait();
+  this->moves = std::move(moves);
+  this->journal_path = journal_path;
+  this->resumed = resumed;
+  files_done = 0;
+  failed = 0;
+  bytes_done = 0;
+  byte_count = 0;
+  start_time = std::chrono::steady_clock::now();
+  busy = true;
+  thread = std::thread(&PhotoMover::move_main, this);
+  return true;
+}
+
+void PhotoMover::wait() {
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+PhotoMover::Progress PhotoMover::get_progress() const {
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start_time;
+  uint64_t bytes = bytes_done;
+  return Progress{
+      .files_done = files_done,
+      .file_count = moves.size(),
+      .bytes_done = bytes,
+      .byte_count = byte_count,
+      .bytes_per_second = elapsed.count() > 0.0 ? bytes / elapsed.count() : 0.0,
+      .failed = failed,
+  };
+}
+
+void PhotoMover::add_moved_bytes(const std::filesystem::path &path) {
+  // file_size returns uintmax_t(-1) on error, which would wrap the counter
+  std::error_code error;
+  uintmax_t size = std::filesystem::file_size(path, error);
+  if (!error) {
+    bytes_done += size;
+  }
+}
+
+void PhotoMover::move_main() {
+  // Sizes are only for the progress bar, stat them here since the folder
+  // can be on a slow network share
+  for (const FileMove &move : moves) {
+    std::error_code error;
+    uintmax_t size = std::filesystem::file_size(move.from, error);
+    if (!error) {
+      byte_count += size;
+    }
+  }
+  if (!resumed) {
+    number_collisions(moves);
+  }
+  // Nothing moves until the whole batch is on disk
+  if (!journal.create(journal_path, moves)) {
+    SDL_Log("WARNING: finalizing without a journal");
+  }
+
+  // Renames first, they're instant. Whatever has to cross filesystems goes
+  // to the copy engine in one batch so several files can be in flight.
+  std::vector<FileMove> copies;
+  std::vector<size_t> copy_indices;
+  for (size_t i = 0; i < moves.size(); i++) {
+    const FileMove &move = moves[i];
+    std::error_code error;
+    // Already moved by a batch that didn't get to record it
+    if (!std::filesystem::exists(move.from, error) &&
+        std::filesystem::exists(move.to, error)) {
+      add_moved_bytes(move.to);
+      journal.mark_done(i);
+      files_done++;
+      continue;
+    }
+
+    CopyEngine::rename_no_replace(move.from, move.to, error);
+    if (error == std::errc::cross_device_link) {
+      copies.push_back(move);
+      copy_indices.push_back(i);
+      continue;
+    }
+    if (error) {
+      SDL_Log("ERROR: moving %s: %s", move.from.string().c_str(),
+              error.message().c_str());
+      failed++;
+    } else {
+      add_moved_bytes(move.to);
+      journal.mark_done(i);
+    }
+    files_done++;
+  }
+
+  if (!copies.empty()) {
+    CopyEngine::Stats stats = CopyEngine::copy_files(
+        copies, bytes_done, [this, &copies, &copy_indices](size_t index,
+                                                          bool copied) {
+          if (copied) {
+            std::error_code error;
+            std::filesystem::remove(copies[index].from, error);
+            if (error) {
+              SDL_Log("WARNING: removing %s after copying it: %s",
+                      copies[index].from.string().c_str(),
+                      error.message().c_str());
+            }
+            journal.mark_done(copy_indices[index]);
+          } else {
+            failed++;
+          }
+          files_done++;
+        });
+    SDL_Log("Copied %zu files, %.1f MB in %.2fs (%.1f MB/s, %s)",
+            copies.size(), stats.bytes / 1e6, stats.seconds,
+            stats.seconds > 0.0 ? stats.bytes / 1e6 / stats.seconds : 0.0,
+            stats.backend);
+  }
+  if (failed > 0) {
+    journal.close();
+  } else {
+    journal.finish();
+  }
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start_time;
+  SDL_Log("Moved %zu files (%zu failed) in %.2fs", moves.size(),
+          static_cast<size_t>(failed), elapsed.count());
+  busy = false;
+}
@@ -0,0 +1,293 @@
+#include "pixel_convert.hpp"
+
+#include <initializer_list>
+
+#include "SDL3/SDL_cpuinfo.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) ||            \
+    defined(_M_IX86)
+#define SR_X86 1
+#include <immintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define SR_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SR_TARGET_AVX2
+#endif
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+#define SR_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace PixelConvert {
+
+// Scalar
+
+static void convert_scalar(const uint16_t *src, uint8_t *dst, size_t count,
+                           int shift) {
+  for (size_t i = 0; i < count; i++) {
+    dst[i] = static_cast<uint8_t>(src[i] >> shift);
+  }
+}
+
+// Rounds like the SIMD averages do, (a + b + 1) / 2 twice
+static void convert_half_scalar(const uint16_t *row0, const uint16_t *row1,
+                                uint8_t *dst, int dst_width, int shift) {
+  for (int x = 0; x < dst_width; x++) {
+    for (int c = 0; c < 4; c++) {
+      uint32_t left = (uint32_t(row0[x * 8 + c]) + row1[x * 8 + c] + 1) >> 1;
+      uint32_t right =
+          (uint32_t(row0[x * 8 + 4 + c]) + row1[x * 8 + 4 + c] + 1) >> 1;
+      dst[x * 4 + c] = static_cast<uint8_t>(((left + right + 1) >> 1) >> shift);
+    }
+  }
+}
+
+// SSE2 and AVX2
+
+#ifdef SR_X86
+static void convert_sse2(const uint16_t *src, uint8_t *dst, size_t count,
+                         int shift) {
+  __m128i shift_count = _mm_cvtsi32_si128(shift);
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 8));
+    a = _mm_srl_epi16(a, shift_count);
+    b = _mm_srl_epi16(b, shift_count);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+                     _mm_packus_epi16(a, b));
+  }
+  convert_scalar(src + i, dst + i, count - i, shift);
+}
+
+// Two source pixels are 128 bits, so pairs of pixels get averaged by
+// splitting two registers into their even and odd halves
+static void convert_half_sse2(const uint16_t *row0, const uint16_t *row1,
+                              uint8_t *dst, int dst_width, int shift) {
+  __m128i shift_count = _mm_cvtsi32_si128(shift);
+  int x = 0;
+  for (; x + 4 <= dst_width; x += 4) {
+    const uint16_t *p0 = row0 + x * 8;
+    const uint16_t *p1 = row1 + x * 8;
+    __m128i v[4];
+    for (int j = 0; j < 4; j++) {
+      __m128i top = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p0 + j * 8));
+      __m128i bottom =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(p1 + j * 8));
+      v[j] = _mm_avg_epu16(top, bottom);
+    }
+    __m128i pair01 = _mm_avg_epu16(_mm_unpacklo_epi64(v[0], v[1]),
+                                   _mm_unpackhi_epi64(v[0], v[1]));
+    __m128i pair23 = _mm_avg_epu16(_mm_unpacklo_epi64(v[2], v[3]),
+                                   _mm_unpackhi_epi64(v[2], v[3]));
+    pair01 = _mm_srl_epi16(pair01, shift_count);
+    pair23 = _mm_srl_epi16(pair23, shift_count);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * 4),
+                     _mm_packus_epi16(pair01, pair23));
+  }
+  convert_half_scalar(row0 + x * 8, row1 + x * 8, dst + x * 4, dst_width - x,
+                      shift);
+}
+
+SR_TARGET_AVX2
+static void convert_avx2(const uint16_t *src, uint8_t *dst, size_t count,
+                         int shift) {
+  __m128i shift_count = _mm_cvtsi32_si128(shift);
+  size_t i = 0;
+  for (; i + 32 <= count; i += 32) {
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+    __m256i b =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i + 16));
+    a = _mm256_srl_epi16(a, shift_count);
+    b = _mm256_srl_epi16(b, shift_count);
+    // packus works per 128-bit lane, put the quarters back in order
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b),
+                                              _MM_SHUFFLE(3, 1, 2, 0));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), packed);
+  }
+  convert_scalar(src + i, dst + i, count - i, shift);
+}
+
+SR_TARGET_AVX2
+static void convert_half_avx2(const uint16_t *row0, const uint16_t *row1,
+                              uint8_t *dst, int dst_width, int shift) {
+  __m128i shift_count = _mm_cvtsi32_si128(shift);
+  // unpack and pack both work per lane, this undoes the shuffle
+  const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  int x = 0;
+  for (; x + 8 <= dst_width; x += 8) {
+    const uint16_t *p0 = row0 + x * 8;
+    const uint16_t *p1 = row1 + x * 8;
+    __m256i v[4];
+    for (int j = 0; j < 4; j++) {
+      __m256i top =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p0 + j * 16));
+      __m256i bottom =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p1 + j * 16));
+      v[j] = _mm256_avg_epu16(top, bottom);
+    }
+    __m256i pairs_a = _mm256_avg_epu16(_mm256_unpacklo_epi64(v[0], v[1]),
+                                       _mm256_unpackhi_epi64(v[0], v[1]));
+    __m256i pairs_b = _mm256_avg_epu16(_mm256_unpacklo_epi64(v[2], v[3]),
+                                       _mm256_unpackhi_epi64(v[2], v[3]));
+    pairs_a = _mm256_srl_epi16(pairs_a, shift_count);
+    pairs_b = _mm256_srl_epi16(pairs_b, shift_count);
+    __m256i packed = _mm256_permutevar8x32_epi32(
+        _mm256_packus_epi16(pairs_a, pairs_b), order);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + x * 4), packed);
+  }
+  convert_half_sse2(row0 + x * 8, row1 + x * 8, dst + x * 4, dst_width - x,
+                    shift);
+}
+#endif
+
+// NEON
+
+#ifdef SR_NEON
+static void convert_neon(const uint16_t *src, uint8_t *dst, size_t count,
+                         int shift) {
+  int16x8_t shift_right = vdupq_n_s16(static_cast<int16_t>(-shift));
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    uint16x8_t a = vshlq_u16(vld1q_u16(src + i), shift_right);
+    uint16x8_t b = vshlq_u16(vld1q_u16(src + i + 8), shift_right);
+    vst1q_u8(dst + i, vcombine_u8(vqmovn_u16(a), vqmovn_u16(b)));
+  }
+  convert_scalar(src + i, dst + i, count - i, shift);
+}
+
+static void convert_half_neon(const uint16_t *row0, const uint16_t *row1,
+                              uint8_t *dst, int dst_width, int shift) {
+  int16x8_t shift_right = vdupq_n_s16(static_cast<int16_t>(-shift));
+  int x = 0;
+  for (; x + 4 <= dst_width; x += 4) {
+    const uint16_t *p0 = row0 + x * 8;
+    const uint16_t *p1 = row1 + x * 8;
+    uint16x8_t v[4];
+    for (int j = 0; j < 4; j++) {
+      v[j] = vrhaddq_u16(vld1q_u16(p0 + j * 8), vld1q_u16(p1 + j * 8));
+    }
+    uint16x8_t pair01 =
+        vrhaddq_u16(vcombine_u16(vget_low_u16(v[0]), vget_low_u16(v[1])),
+                    vcombine_u16(vget_high_u16(v[0]), vget_high_u16(v[1])));
+    uint16x8_t pair23 =
+        vrhaddq_u16(vcombine_u16(vget_low_u16(v[2]), vget_low_u16(v[3])),
+                    vcombine_u16(vget_high_u16(v[2]), vget_high_u16(v[3])));
+    pair01 = vshlq_u16(pair01, shift_right);
+    pair23 = vshlq_u16(pair23, shift_right);
+    vst1q_u8(dst + x * 4,
+             vcombine_u8(vqmovn_u16(pair01), vqmovn_u16(pair23)));
+  }
+  convert_half_scalar(row0 + x * 8, row1 + x * 8, dst + x * 4, dst_width - x,
+                      shift);
+}
+#endif
+
+// Dispatch
+
+typedef void (*ConvertFunction)(const uint16_t *, uint8_t *, size_t, int);
+typedef void (*ConvertHalfFunction)(const uint16_t *, const uint16_t *,
+                                    uint8_t *, int, int);
+
+static ConvertFunction convert_functions[KERNEL_COUNT] = {
+    convert_scalar,
+#ifdef SR_X86
+    convert_sse2,
+    convert_avx2,
+#else
+    nullptr,
+    nullptr,
+#endif
+#ifdef SR_NEON
+    convert_neon,
+#else
+    nullptr,
+#endif
+};
+
+static ConvertHalfFunction convert_half_functions[KERNEL_COUNT] = {
+    convert_half_scalar,
+#ifdef SR_X86
+    convert_half_sse2,
+    convert_half_avx2,
+#else
+    nullptr,
+    nullptr,
+#endif
+#ifdef SR_NEON
+    convert_half_neon,
+#else
+    nullptr,
+#endif
+};
+
+const char *kernel_name(Kernel kernel) {
+  switch (kernel) {
+  case KERNEL_SCALAR:
+    return "scalar";
+  case KERNEL_SSE2:
+    return "SSE2";
+  case KERNEL_AVX2:
+    return "AVX2";
+  case KERNEL_NEON:
+    return "NEON";
+  default:
+    return "unknown";
+  }
+}
+
+bool kernel_supported(Kernel kernel) {
+  if (kernel < 0 || kernel >= KERNEL_COUNT || !convert_functions[kernel]) {
+    return false;
+  }
+  switch (kernel) {
+  case KERNEL_SSE2:
+    return SDL_HasSSE2();
+  case KERNEL_AVX2:
+    return SDL_HasAVX2();
+  case KERNEL_NEON:
+    return SDL_HasNEON();
+  default:
+    return true;
+  }
+}
+
+Kernel best_kernel() {
+  static const Kernel best = [] {
+    for (Kernel kernel : {KERNEL_AVX2, KERNEL_NEON, KERNEL_SSE2}) {
+      if (kernel_supported(kernel)) {
+        return kernel;
+      }
+    }
+    return KERNEL_SCALAR;
+  }();
+  return best;
+}
+
+void rgba16_to_rgba8(const uint16_t *src, uint8_t *dst, size_t pixel_count,
+                     int precision, Kernel kernel) {
+  if (!kernel_supported(kernel)) {
+    kernel = KERNEL_SCALAR;
+  }
+  convert_functions[kernel](src, dst, pixel_count * 4, precision - 8);
+}
+
+void rgba16_to_rgba8_half(const uint16_t *src, int src_width, int src_height,
+                          uint8_t *dst, int precision, Kernel kernel) {
+  if (!kernel_supported(kernel)) {
+    kernel = KERNEL_SCALAR;
+  }
+  int dst_width = src_width / 2;
+  int dst_height = src_height / 2;
+  size_t src_pitch = size_t(src_width) * 4;
+  for (int y = 0; y < dst_height; y++) {
+    const uint16_t *row0 = src + size_t(y) * 2 * src_pitch;
+    convert_half_functions[kernel](row0, row0 + src_pitch,
+                                   dst + size_t(y) * dst_width * 4, dst_width,
+                                   precision - 8);
+  }
+}
+
+} // namespace PixelConvert
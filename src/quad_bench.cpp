@@ -0,0 +1,121 @@
+#include "quad_bench.hpp"
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "SDL3/SDL.h"
+
+namespace QuadBench {
+
+static const int warmup_frames = 20;
+static const int measured_frames = 60;
+static const int first_item_count = 64;
+static const int last_item_count = 32768;
+// More than fit in one instanced draw, like thumbnails in a photo grid
+static const int texture_count = 4 * QUAD_TEXTURE_SLOTS;
+static const int texture_size = 64;
+
+static std::string texture_path(int index) {
+  return "QUAD_BENCH_" + std::to_string(index);
+}
+
+static bool load_textures(Renderer &renderer) {
+  std::vector<std::vector<Uint32>> pixels(texture_count);
+  std::vector<TextureUpload> uploads;
+  for (int i = 0; i < texture_count; i++) {
+    // ABGR8888, a different shade for each
+    Uint32 shade = static_cast<Uint32>(i * 255 / texture_count);
+    pixels[i].assign(texture_size * texture_size,
+                     0xFF000000u | (shade << 16) | ((255 - shade) << 8) | 128);
+    TextureUpload upload;
+    upload.path = texture_path(i);
+    upload.width = texture_size;
+    upload.height = texture_size;
+    upload.pixels = pixels[i].data();
+    uploads.push_back(upload);
+  }
+  return renderer.load_textures(uploads);
+}
+
+// What a photo grid cell draws: background, thumbnail, selection ring and
+// file name
+static void draw_items(Renderer &renderer, int item_count) {
+  glm::vec2 view_size = glm::vec2(renderer.width, renderer.height) /
+                        renderer.viewport_scale;
+  float aspect = view_size.x / SDL_max(view_size.y, 1.0f);
+  int columns = SDL_max(
+      1, static_cast<int>(std::ceil(std::sqrt(item_count * aspect))));
+  int rows = (item_count + columns - 1) / columns;
+  glm::vec2 cell = view_size / glm::vec2(columns, rows);
+
+  char label[32];
+  for (int i = 0; i < item_count; i++) {
+    glm::vec2 position(static_cast<float>(i % columns) * cell.x,
+                       static_cast<float>(i / columns) * cell.y);
+    renderer.draw_color_rect(position, cell,
+                             glm::vec4(0.1f, 0.1f, 0.1f, 1.0f),
+                             glm::vec4(4.0f));
+    renderer.draw_texture_rect(texture_path(i % texture_count),
+                               position + cell * 0.1f, cell * 0.8f,
+                               glm::vec4(1.0f), glm::vec4(4.0f), false);
+    renderer.draw_arc(position + cell * 0.5f, SDL_min(cell.x, cell.y) * 0.2f,
+                      2.0f, static_cast<float>(i * 10 % 360),
+                      glm::vec4(1.0f, 1.0f, 1.0f, 0.5f));
+    int label_length = SDL_snprintf(label, sizeof(label), "DSCF%04d.JPG", i);
+    renderer.draw_text(label, label_length, 8.0f, position + cell * 0.1f,
+                       glm::vec4(1.0f));
+  }
+}
+
+bool run(Renderer &renderer) {
+  if (!load_textures(renderer)) {
+    SDL_Log("Quad benchmark: loading textures failed");
+    return false;
+  }
+
+  bool finished = true;
+  SDL_Log("Quad benchmark: CPU time per frame from draw calls to submit");
+  for (int item_count = first_item_count;
+       item_count <= last_item_count && finished; item_count *= 2) {
+    Uint64 total_ticks = 0;
+    for (int frame = 0; frame < warmup_frames + measured_frames; frame++) {
+      SDL_Event event;
+      while (SDL_PollEvent(&event)) {
+        if (event.type == SDL_EVENT_QUIT) {
+          finished = false;
+        }
+      }
+      if (!finished) {
+        break;
+      }
+
+      // Not timed, this waits on the swapchain
+      renderer.begin_frame();
+      Uint64 start = SDL_GetPerformanceCounter();
+      draw_items(renderer, item_count);
+      renderer.end_frame();
+      if (frame >= warmup_frames) {
+        total_ticks += SDL_GetPerformanceCounter() - start;
+      }
+    }
+    if (!finished) {
+      break;
+    }
+
+    double milliseconds = static_cast<double>(total_ticks) * 1000.0 /
+                          SDL_GetPerformanceFrequency() / measured_frames;
+    const RenderStats &stats = renderer.get_frame_stats();
+    SDL_Log("%6d items, %7u quads and glyphs: %8.3f ms, %5u draws, "
+            "%4u sampler binds",
+            item_count, stats.instances, milliseconds, stats.draws,
+            stats.sampler_binds);
+  }
+
+  for (int i = 0; i < texture_count; i++) {
+    renderer.destroy_texture(texture_path(i));
+  }
+  return finished;
+}
+
+} // namespace QuadBench
@@ -0,0 +1,263 @@
+#include "raw_preview.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <string>
+
+#include "tiff.hpp"
+
+namespace RawPreview {
+
+static const char *raw_extensions[] = {".raf", ".nef", ".nrw", ".arw",
+                                       ".dng", ".cr2", ".cr3"};
+
+// Canon's preview box, uuid eaf42b5e-1c98-4b88-b9fb-b7dc406e4d16
+static const uint8_t cr3_preview_uuid[16] = {
+    0xea, 0xf4, 0x2b, 0x5e, 0x1c, 0x98, 0x4b, 0x88,
+    0xb9, 0xfb, 0xb7, 0xdc, 0x40, 0x6e, 0x4d, 0x16};
+
+// Photometric interpretations of sensor data, never a preview
+static const uint32_t PHOTOMETRIC_CFA = 32803;
+static const uint32_t PHOTOMETRIC_LINEAR_RAW = 34892;
+
+bool is_raw(const std::filesystem::path &path) {
+  std::string extension = path.extension().string();
+  for (char &c : extension) {
+    c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  }
+  for (const char *raw_extension : raw_extensions) {
+    if (extension == raw_extension) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static uint32_t read_u32_be(const uint8_t *p) {
+  return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 |
+         uint32_t(p[3]);
+}
+
+static uint64_t read_u64_be(const uint8_t *p) {
+  return uint64_t(read_u32_be(p)) << 32 | read_u32_be(p + 4);
+}
+
+// Only keeps ranges that are inside the file and look like a JPEG
+static void add_preview(const uint8_t *data, size_t size, uint64_t offset,
+                        uint64_t length,
+                        std::vector<Exif::EmbeddedImage> &previews) {
+  if (length < 4 || offset >= size || length > size - offset ||
+      data[offset] != 0xFF || data[offset + 1] != 0xD8) {
+    return;
+  }
+  for (const Exif::EmbeddedImage &preview : previews) {
+    if (preview.offset == offset) {
+      return;
+    }
+  }
+  previews.push_back(Exif::EmbeddedImage{.offset = size_t(offset),
+                                         .length = size_t(length)});
+}
+
+// Fujifilm puts the JPEG offset and length at fixed spots in its header
+static void parse_raf(const uint8_t *data, size_t size,
+                      std::vector<Exif::EmbeddedImage> &previews) {
+  if (size < 92) {
+    return;
+  }
+  add_preview(data, size, read_u32_be(data + 84), read_u32_be(data + 88),
+              previews);
+}
+
+static void parse_tiff(const uint8_t *data, size_t size,
+                       std::vector<Exif::EmbeddedImage> &previews) {
+  TiffReader tiff{.base = data, .size = size};
+  uint32_t first_ifd;
+  if (!tiff.header(first_ifd)) {
+    return;
+  }
+
+  // Walks IFD0's chain and every SubIFD without recursion, the limit keeps
+  // broken files with IFD loops from spinning forever
+  const int max_ifds = 32;
+  uint32_t pending[max_ifds];
+  uint32_t visited[max_ifds];
+  int pending_count = 0;
+  int visited_count = 0;
+  pending[pending_count++] = first_ifd;
+
+  while (pending_count > 0 && visited_count < max_ifds) {
+    uint32_t ifd = pending[--pending_count];
+    if (ifd == 0 || std::find(visited, visited + visited_count, ifd) !=
+                        visited + visited_count) {
+      continue;
+    }
+    visited[visited_count++] = ifd;
+
+    uint32_t offset;
+    uint32_t length;
+    if (tiff.find_tag(ifd, TiffTag::JPEG_INTERCHANGE_FORMAT, offset) &&
+        tiff.find_tag(ifd, TiffTag::JPEG_INTERCHANGE_FORMAT_LENGTH, length)) {
+      add_preview(data, size, offset, length, previews);
+    }
+
+    // A single JPEG compressed strip (DNG previews, some NEF SubIFDs)
+    uint32_t compression;
+    uint32_t photometric = 0;
+    uint32_t strip_count = 0;
+    tiff.find_tag(ifd, TiffTag::PHOTOMETRIC_INTERPRETATION, photometric);
+    if (tiff.find_tag(ifd, TiffTag::COMPRESSION, compression) &&
+        (compression == 6 || compression == 7) &&
+        photometric != PHOTOMETRIC_CFA &&
+        photometric != PHOTOMETRIC_LINEAR_RAW &&
+        tiff.find_tag(ifd, TiffTag::STRIP_OFFSETS, offset, &strip_count) &&
+        strip_count == 1 &&
+        tiff.find_tag(ifd, TiffTag::STRIP_BYTE_COUNTS, length)) {
+      add_preview(data, size, offset, length, previews);
+    }
+
+    uint32_t sub_ifds;
+    uint32_t sub_ifd_count = 0;
+    if (tiff.find_tag(ifd, TiffTag::SUB_IFDS, sub_ifds, &sub_ifd_count)) {
+      if (sub_ifd_count == 1) {
+        pending[pending_count++] = sub_ifds;
+      } else {
+        for (uint32_t i = 0; i < sub_ifd_count && pending_count < max_ifds;
+             i++) {
+          uint32_t sub_ifd;
+          if (tiff.u32(sub_ifds + i * 4, sub_ifd)) {
+            pending[pending_count++] = sub_ifd;
+          }
+        }
+      }
+    }
+    uint32_t next;
+    if (pending_count < max_ifds && tiff.next_ifd(ifd, next)) {
+      pending[pending_count++] = next;
+    }
+  }
+}
+
+// ISO BMFF box, content spans [content, end)
+struct Box {
+  char type[4];
+  size_t content;
+  size_t end;
+};
+
+// Finds the first box of the given type among the boxes in [begin, end)
+static bool find_box(const uint8_t *data, size_t begin, size_t end,
+                     const char *type, Box &box) {
+  size_t offset = begin;
+  while (offset + 8 <= end) {
+    uint64_t box_size = read_u32_be(data + offset);
+    size_t header_size = 8;
+    if (box_size == 1) {
+      if (offset + 16 > end) {
+        return false;
+      }
+      box_size = read_u64_be(data + offset + 8);
+      header_size = 16;
+    } else if (box_size == 0) {
+      box_size = end - offset;
+    }
+    if (box_size < header_size || box_size > end - offset) {
+      return false;
+    }
+    if (memcmp(data + offset + 4, type, 4) == 0) {
+      memcpy(box.type, type, 4);
+      box.content = offset + header_size;
+      box.end = offset + box_size;
+      return true;
+    }
+    offset += box_size;
+  }
+  return false;
+}
+
+// First trak of a CR3 is a full size JPEG, its sample table points at it
+static void parse_cr3_jpeg_track(const uint8_t *data, size_t size,
+                                 const Box &moov,
+                                 std::vector<Exif::EmbeddedImage> &previews) {
+  Box trak, mdia, minf, stbl, stsz;
+  if (!find_box(data, moov.content, moov.end, "trak", trak) ||
+      !find_box(data, trak.content, trak.end, "mdia", mdia) ||
+      !find_box(data, mdia.content, mdia.end, "minf", minf) ||
+      !find_box(data, minf.content, minf.end, "stbl", stbl) ||
+      !find_box(data, stbl.content, stbl.end, "stsz", stsz) ||
+      stsz.content + 16 > stsz.end) {
+    return;
+  }
+  // version/flags, sample size, sample count, then the per sample sizes
+  uint64_t length = read_u32_be(data + stsz.content + 4);
+  if (length == 0) {
+    length = read_u32_be(data + stsz.content + 12);
+  }
+
+  Box chunk_offsets;
+  uint64_t offset;
+  if (find_box(data, stbl.content, stbl.end, "co64", chunk_offsets) &&
+      chunk_offsets.content + 16 <= chunk_offsets.end) {
+    offset = read_u64_be(data + chunk_offsets.content + 8);
+  } else if (find_box(data, stbl.content, stbl.end, "stco", chunk_offsets) &&
+             chunk_offsets.content + 12 <= chunk_offsets.end) {
+    offset = read_u32_be(data + chunk_offsets.content + 8);
+  } else {
+    return;
+  }
+  add_preview(data, size, offset, length, previews);
+}
+
+// The PRVW box holds a ~1620px JPEG behind a small header
+static void parse_cr3_prvw(const uint8_t *data, size_t size,
+                           std::vector<Exif::EmbeddedImage> &previews) {
+  size_t offset = 0;
+  Box uuid;
+  while (find_box(data, offset, size, "uuid", uuid)) {
+    offset = uuid.end;
+    if (uuid.content + 16 > uuid.end ||
+        memcmp(data + uuid.content, cr3_preview_uuid, 16) != 0) {
+      continue;
+    }
+    // uuid, 8 unknown bytes, then the PRVW box
+    Box prvw;
+    if (!find_box(data, uuid.content + 24, uuid.end, "PRVW", prvw) ||
+        prvw.content + 16 > prvw.end) {
+      return;
+    }
+    // unknown u32, u16, width u16, height u16, u16, jpeg length u32
+    uint64_t length = read_u32_be(data + prvw.content + 12);
+    add_preview(data, size, prvw.content + 16, length, previews);
+    return;
+  }
+}
+
+static void parse_cr3(const uint8_t *data, size_t size,
+                      std::vector<Exif::EmbeddedImage> &previews) {
+  Box moov;
+  if (find_box(data, 0, size, "moov", moov)) {
+    parse_cr3_jpeg_track(data, size, moov, previews);
+  }
+  parse_cr3_prvw(data, size, previews);
+}
+
+bool find_previews(const uint8_t *data, size_t size,
+                   std::vector<Exif::EmbeddedImage> &previews) {
+  previews.clear();
+  if (size >= 16 && memcmp(data, "FUJIFILMCCD-RAW ", 16) == 0) {
+    parse_raf(data, size, previews);
+  } else if (size >= 12 && memcmp(data + 4, "ftypcrx ", 8) == 0) {
+    parse_cr3(data, size, previews);
+  } else {
+    parse_tiff(data, size, previews);
+  }
+
+  std::sort(previews.begin(), previews.end(),
+            [](const Exif::EmbeddedImage &a, const Exif::EmbeddedImage &b) {
+              return a.length < b.length;
+            });
+  return !previews.empty();
+}
+
+} // namespace RawPreview
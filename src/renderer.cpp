@@ -4,6 +4,8 @@
 #include "SDL3_ttf/SDL_ttf.h"
 #include "glm/gtc/matrix_transform.hpp"
 
+#include "config.hpp"
+
 // Helpers
 SDL_GPUShader *load_shader(SDL_GPUDevice *device, std::string path,
                            int num_samplers, int num_storage_textures,
@@ -135,6 +137,202 @@ bool Renderer::load_texture(std::string path, SDL_Surface *image_data) {
   return true;
 }
 
+// Same as load_texture, but every texture shares one transfer buffer, one copy
+// pass and one command buffer submission
+bool Renderer::load_textures(const std::vector<TextureUpload> &uploads) {
+  Uint32 total_size = 0;
+  for (const TextureUpload &upload : uploads) {
+    total_size += upload.width * upload.height * 4; // 4 is RGBA8888
+  }
+  if (total_size == 0) {
+    return true;
+  }
+
+  SDL_GPUTransferBufferCreateInfo texture_transfer_create_info{};
+  texture_transfer_create_info.usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD;
+  texture_transfer_create_info.size = total_size;
+  SDL_GPUTransferBuffer *texture_transfer_buffer = SDL_CreateGPUTransferBuffer(
+      this->context.device, &texture_transfer_create_info);
+  if (!texture_transfer_buffer) {
+    SDL_Log("Failed to create texture transfer buffer: %s", SDL_GetError());
+    return false;
+  }
+
+  Uint8 *texture_data_ptr = (Uint8 *)SDL_MapGPUTransferBuffer(
+      this->context.device, texture_transfer_buffer, false);
+  Uint32 offset = 0;
+  for (const TextureUpload &upload : uploads) {
+    Uint32 size = upload.width * upload.height * 4;
+    SDL_memcpy(texture_data_ptr + offset, upload.pixels, size);
+    offset += size;
+  }
+  SDL_UnmapGPUTransferBuffer(this->context.device, texture_transfer_buffer);
+
+  SDL_GPUCommandBuffer *_command_buffer =
+      SDL_AcquireGPUCommandBuffer(this->context.device);
+  SDL_GPUCopyPass *copyPass = SDL_BeginGPUCopyPass(_command_buffer);
+
+  bool success = true;
+  offset = 0;
+  for (const TextureUpload &upload : uploads) {
+    Uint32 size = upload.width * upload.height * 4;
+    bool exists = false;
+    if (upload.level < 0) {
+      exists = gpu_textures.find(upload.path) != gpu_textures.end();
+    } else if (upload.level < MAX_TEXTURE_LEVELS) {
+      auto pyramid = texture_pyramids.find(upload.path);
+      exists = pyramid != texture_pyramids.end() &&
+               pyramid->second.levels[upload.level];
+    } else {
+      SDL_Log("Texture level %d out of range for %s", upload.level,
+              upload.path.c_str());
+      exists = true;
+    }
+    if (exists) {
+      offset += size;
+      continue;
+    }
+
+    SDL_GPUTextureCreateInfo texture_info{};
+    texture_info.type = SDL_GPU_TEXTURETYPE_2D;
+    texture_info.format = SDL_GPU_TEXTUREFORMAT_R8G8B8A8_UNORM;
+    texture_info.usage = SDL_GPU_TEXTUREUSAGE_SAMPLER;
+    texture_info.width = upload.width;
+    texture_info.height = upload.height;
+    texture_info.layer_count_or_depth = 1;
+    texture_info.num_levels = 1;
+
+    SDL_GPUTexture *texture =
+        SDL_CreateGPUTexture(this->context.device, &texture_info);
+    if (!texture) {
+      SDL_LogError(SDL_LOG_CATEGORY_APPLICATION,
+                   "Failed to create GPU texture: %s", SDL_GetError());
+      success = false;
+      offset += size;
+      continue;
+    }
+
+    SDL_GPUTextureTransferInfo texture_transfer_info{};
+    texture_transfer_info.transfer_buffer = texture_transfer_buffer;
+    texture_transfer_info.offset = offset;
+    SDL_GPUTextureRegion texture_region{};
+    texture_region.texture = texture;
+    texture_region.w = upload.width;
+    texture_region.h = upload.height;
+    texture_region.d = 1;
+    SDL_UploadToGPUTexture(copyPass, &texture_transfer_info, &texture_region,
+                           false);
+
+    if (upload.level < 0) {
+      gpu_textures[upload.path] = texture;
+    } else {
+      TexturePyramid &pyramid = texture_pyramids[upload.path];
+      pyramid.levels[upload.level] = texture;
+      pyramid.widths[upload.level] = upload.width;
+    }
+    offset += size;
+  }
+
+  SDL_EndGPUCopyPass(copyPass);
+  SDL_SubmitGPUCommandBuffer(_command_buffer);
+  SDL_ReleaseGPUTransferBuffer(this->context.device, texture_transfer_buffer);
+
+  return success;
+}
+
+// Queued draws may still point at the texture, those get submitted first
+void Renderer::release_texture(SDL_GPUTexture *texture) {
+  for (const DrawCommand &command : draw_commands) {
+    if (command.texture == texture) {
+      flush();
+      break;
+    }
+  }
+  SDL_ReleaseGPUTexture(this->context.device, texture);
+}
+
+bool Renderer::destroy_texture(const std::string &path) {
+  bool destroyed = false;
+  auto it = gpu_textures.find(path);
+  if (it != gpu_textures.end()) {
+    release_texture(it->second);
+    gpu_textures.erase(it);
+    destroyed = true;
+  }
+  auto pyramid = texture_pyramids.find(path);
+  if (pyramid != texture_pyramids.end()) {
+    for (SDL_GPUTexture *texture : pyramid->second.levels) {
+      if (texture) {
+        release_texture(texture);
+      }
+    }
+    texture_pyramids.erase(pyramid);
+    destroyed = true;
+  }
+  return destroyed;
+}
+
+bool Renderer::destroy_texture_level(const std::string &path, int level) {
+  auto pyramid = texture_pyramids.find(path);
+  if (pyramid == texture_pyramids.end() || level < 0 ||
+      level >= MAX_TEXTURE_LEVELS || !pyramid->second.levels[level]) {
+    return false;
+  }
+  release_texture(pyramid->second.levels[level]);
+  pyramid->second.levels[level] = nullptr;
+  pyramid->second.widths[level] = 0;
+
+  for (SDL_GPUTexture *texture : pyramid->second.levels) {
+    if (texture) {
+      return true;
+    }
+  }
+  texture_pyramids.erase(pyramid);
+  return true;
+}
+
+int choose_texture_level(const int *widths, int level_count,
+                         uint32_t available_levels, float pixel_width) {
+  int largest = -1;
+  for (int level = 0; level < level_count; level++) {
+    if (!(available_levels & (1u << level))) {
+      continue;
+    }
+    if (widths[level] >= pixel_width) {
+      return level;
+    }
+    largest = level;
+  }
+  return largest;
+}
+
+int Renderer::texture_level(const int *widths, int level_count,
+                            uint32_t available_levels, float width) const {
+  return choose_texture_level(widths, level_count, available_levels,
+                              width * viewport_scale);
+}
+
+SDL_GPUTexture *Renderer::find_texture(const std::string &path,
+                                       float width) {
+  auto it = gpu_textures.find(path);
+  if (it != gpu_textures.end()) {
+    return it->second;
+  }
+  auto pyramid = texture_pyramids.find(path);
+  if (pyramid == texture_pyramids.end()) {
+    return nullptr;
+  }
+  uint32_t available_levels = 0;
+  for (int level = 0; level < MAX_TEXTURE_LEVELS; level++) {
+    if (pyramid->second.levels[level]) {
+      available_levels |= 1u << level;
+    }
+  }
+  int level = texture_level(pyramid->second.widths, MAX_TEXTURE_LEVELS,
+                            available_levels, width);
+  return level < 0 ? nullptr : pyramid->second.levels[level];
+}
+
 bool Renderer::load_geometry(std::string path, const Vertex *vertices,
                              size_t vertex_size, const Uint16 *indices,
                              size_t index_size) {
@@ -375,9 +573,9 @@ bool Renderer::init() {
   SDL_GPUShader *basic_vertex_shader = load_shader(
       this->context.device, "src/shaders/basic.vert.spv", 0, 0, 0, 1);
 
-  // Text vertex shader
-  SDL_GPUShader *text_vertex_shader = load_shader(
-      this->context.device, "src/shaders/text.vert.spv", 0, 0, 0, 1);
+  // Quad vertex shader, reads per quad data from a storage buffer
+  SDL_GPUShader *quad_vertex_shader = load_shader(
+      this->context.device, "src/shaders/quad.vert.spv", 0, 0, 1, 1);
 
   // Sprite fragment shader
   SDL_GPUShader *sprite_fragment_shader = load_shader(
@@ -385,32 +583,35 @@ bool Renderer::init() {
 
   // ColorRect fragment shader
   SDL_GPUShader *color_rect_fragment_shader = load_shader(
-      this->context.device, "src/shaders/color_rect.frag.spv", 0, 0, 0, 1);
+      this->context.device, "src/shaders/color_rect.frag.spv", 0, 0, 0, 0);
 
   // TextureRect fragment shader
-  SDL_GPUShader *texture_rect_fragment_shader = load_shader(
-      this->context.device, "src/shaders/texture_rect.frag.spv", 1, 0, 0, 1);
+  SDL_GPUShader *texture_rect_fragment_shader =
+      load_shader(this->context.device, "src/shaders/texture_rect.frag.spv",
+                  QUAD_TEXTURE_SLOTS, 0, 0, 0);
 
-  // Text fragment shader
+  // Text fragment shader, matching how the glyph atlas rasterizes
   SDL_GPUShader *text_fragment_shader = load_shader(
-      this->context.device, "src/shaders/text.frag.spv", 1, 0, 0, 1);
+      this->context.device,
+      glyph_sdf ? "src/shaders/text_sdf.frag.spv" : "src/shaders/text.frag.spv",
+      1, 0, 0, 0);
 
   // Arc fragment shader
   SDL_GPUShader *arc_fragment_shader =
-      load_shader(this->context.device, "src/shaders/arc.frag.spv", 0, 0, 0, 1);
+      load_shader(this->context.device, "src/shaders/arc.frag.spv", 0, 0, 0, 0);
 
   create_graphics_pipeline("SPRITE", basic_vertex_shader,
                            sprite_fragment_shader);
-  create_graphics_pipeline("COLOR_RECT", basic_vertex_shader,
+  create_graphics_pipeline("COLOR_RECT", quad_vertex_shader,
                            color_rect_fragment_shader);
-  create_graphics_pipeline("TEXTURE_RECT", basic_vertex_shader,
+  create_graphics_pipeline("TEXTURE_RECT", quad_vertex_shader,
                            texture_rect_fragment_shader);
-  create_graphics_pipeline("TEXT", text_vertex_shader, text_fragment_shader);
-  create_graphics_pipeline("ARC", basic_vertex_shader, arc_fragment_shader);
+  create_graphics_pipeline("TEXT", quad_vertex_shader, text_fragment_shader);
+  create_graphics_pipeline("ARC", quad_vertex_shader, arc_fragment_shader);
 
   // We don't need to store the shaders after creating the pipeline
   SDL_ReleaseGPUShader(context.device, basic_vertex_shader);
-  SDL_ReleaseGPUShader(context.device, text_vertex_shader);
+  SDL_ReleaseGPUShader(context.device, quad_vertex_shader);
   SDL_ReleaseGPUShader(context.device, sprite_fragment_shader);
   SDL_ReleaseGPUShader(context.device, color_rect_fragment_shader);
   SDL_ReleaseGPUShader(context.device, texture_rect_fragment_shader);
@@ -459,52 +660,11 @@ bool Renderer::init() {
                 std::size(quad_vertices) * sizeof(Vertex), quad_indices,
                 std::size(quad_indices) * sizeof(Uint16));
 
-  std::string font_path = "res/fonts/Doto_Rounded-Black.ttf";
-  TTF_Font *font = TTF_OpenFont(font_path.c_str(), font_sample_point_size);
-  if (!font) {
-    SDL_Log("Failed to load font");
-    SDL_Quit();
-  }
-
-  TTF_ImageType glyph_image_type;
-  static Uint32 W_UNICODE = 34;
-  SDL_Surface *test_glyph =
-      TTF_GetGlyphImage(font, W_UNICODE, &glyph_image_type);
-
-  int height = TTF_GetFontHeight(font);
-  int advance;
-  TTF_GetGlyphMetrics(font, W_UNICODE, NULL, NULL, NULL, NULL, &advance);
-
-  this->glyph_size = glm::vec2(advance, height);
-
-  SDL_Surface *ascii_glyph_atlas =
-      SDL_CreateSurface(advance * 10, height * 10, test_glyph->format);
-  SDL_DestroySurface(test_glyph);
-
-  for (int i = 33; i <= 126; i++) {
-    int x = (i - 33) % 10;
-    int y = (i - 33) / 10;
-    // Draw test BG
-    // SDL_Rect bg = {x * advance, y * height, advance, height};
-    // SDL_FillSurfaceRect(ascii_glyph_atlas, &bg,
-    //                     (x + y) % 2 == 0 ? 0xFF0000FF : 0xFFFF0000);
-    SDL_Surface *glyph = TTF_GetGlyphImage(font, i, &glyph_image_type);
-
-    int min_x, max_x, min_y, max_y;
-    TTF_GetGlyphMetrics(font, i, &min_x, &max_x, &min_y, &max_y, NULL);
-
-    SDL_Rect dest = {x * advance + min_x,
-                     (y + 1) * height - max_y + TTF_GetFontDescent(font), 0, 0};
-    SDL_BlitSurface(glyph, NULL, ascii_glyph_atlas, &dest);
-
-    SDL_DestroySurface(glyph);
+  // Font ids index this list
+  if (!glyph_atlas.init(context.device, {"res/fonts/Doto_Rounded-Black.ttf"})) {
+    return false;
   }
 
-  this->load_texture("FONT_GLYPH", ascii_glyph_atlas);
-
-  SDL_DestroySurface(ascii_glyph_atlas);
-  TTF_CloseFont(font);
-
   return true;
 }
 
@@ -517,15 +677,34 @@ bool Renderer::begin_frame() {
     return false;
   }
 
-  SDL_GPUTexture *swapchain_texture;
   SDL_WaitAndAcquireGPUSwapchainTexture(_command_buffer, context.window,
-                                        &swapchain_texture, &this->width,
+                                        &_swapchain_texture, &this->width,
                                         &this->height);
 
+  this->projection_matrix =
+      glm::ortho(0.0f, (float)this->width / viewport_scale,
+                 -(float)this->height / viewport_scale, 0.0f);
+
+  // The render pass starts in flush(), instance data has to be uploaded
+  // before it
+  _render_pass = nullptr;
+  frame_cleared = false;
+  draw_commands.clear();
+  queued_instances.clear();
+  scissor_rects.assign(
+      1, SDL_Rect{0, 0, static_cast<int>(width), static_cast<int>(height)});
+  frame_stats = {};
+  glyph_atlas.begin_frame();
+
+  return true;
+}
+
+bool Renderer::begin_render_pass() {
   SDL_GPUColorTargetInfo color_target_info{};
-  color_target_info.texture = swapchain_texture;
+  color_target_info.texture = _swapchain_texture;
   color_target_info.clear_color = SDL_FColor{1.0f, 0.0f, 1.0f, 1.0f};
-  color_target_info.load_op = SDL_GPU_LOADOP_CLEAR;
+  color_target_info.load_op =
+      frame_cleared ? SDL_GPU_LOADOP_LOAD : SDL_GPU_LOADOP_CLEAR;
   color_target_info.store_op = SDL_GPU_STOREOP_STORE;
 
   _render_pass =
@@ -535,68 +714,405 @@ bool Renderer::begin_frame() {
     SDL_Log("Failed to begin GPU render pass");
     return false;
   }
-
-  this->projection_matrix =
-      glm::ortho(0.0f, (float)this->width / viewport_scale,
-                 -(float)this->height / viewport_scale, 0.0f);
-
+  frame_cleared = true;
+  scissor_applied = false;
   return true;
 }
 
 bool Renderer::end_frame() {
-  SDL_EndGPURenderPass(_render_pass);
+  flush();
+  // Nothing drawn still clears the window
+  if (!_render_pass && _swapchain_texture) {
+    begin_render_pass();
+  }
+  if (_render_pass) {
+    SDL_EndGPURenderPass(_render_pass);
+    _render_pass = nullptr;
+  }
 
   SDL_SubmitGPUCommandBuffer(_command_buffer);
 
   this->viewport_scale = SDL_GetWindowPixelDensity(this->context.window);
+  last_frame_stats = frame_stats;
 
   return true;
 }
 
-// TODO: Add a queue_sprite_load() function to load in unavailable sprites
-// TODO: Add a destroy_XX() function to free unused resources
-bool Renderer::draw_sprite(std::string path, glm::vec2 translation,
-                           float rotation, glm::vec2 scale, glm::vec4 color) {
-  // Bind graphics pipeline
-  SDL_BindGPUGraphicsPipeline(_render_pass, graphics_pipelines["SPRITE"]);
+static bool same_draw_state(const DrawCommand &a, const DrawCommand &b) {
+  return a.pipeline == b.pipeline && a.texture == b.texture &&
+         a.sampler == b.sampler;
+}
+
+static bool bounds_overlap(const glm::vec4 &a, const glm::vec4 &b) {
+  // A unit of slack for antialiased edges
+  return a.x < b.z + 1.0f && b.x < a.z + 1.0f && a.y < b.w + 1.0f &&
+         b.y < a.w + 1.0f;
+}
+
+static bool same_rect(const SDL_Rect &a, const SDL_Rect &b) {
+  return a.x == b.x && a.y == b.y && a.w == b.w && a.h == b.h;
+}
+
+template <typename VertexUniforms, typename FragmentUniforms>
+void Renderer::queue_draw(SDL_GPUGraphicsPipeline *pipeline,
+                          SDL_GPUTexture *texture, SDL_GPUSampler *sampler,
+                          glm::vec4 bounds,
+                          const VertexUniforms &vertex_uniforms,
+                          const FragmentUniforms &fragment_uniforms) {
+  static_assert(sizeof(VertexUniforms) <= MAX_VERTEX_UNIFORM_SIZE);
+  static_assert(sizeof(FragmentUniforms) <= MAX_FRAGMENT_UNIFORM_SIZE);
+  DrawCommand &command = draw_commands.emplace_back();
+  command.pipeline = pipeline;
+  command.texture = texture;
+  command.sampler = sampler;
+  command.scissor = static_cast<uint32_t>(scissor_rects.size() - 1);
+  command.bounds = bounds;
+  command.vertex_uniform_size = sizeof(VertexUniforms);
+  command.fragment_uniform_size = sizeof(FragmentUniforms);
+  command.instanced = false;
+  SDL_memcpy(command.vertex_uniforms, &vertex_uniforms,
+             sizeof(VertexUniforms));
+  SDL_memcpy(command.fragment_uniforms, &fragment_uniforms,
+             sizeof(FragmentUniforms));
+}
+
+void Renderer::queue_quads(SDL_GPUGraphicsPipeline *pipeline,
+                           SDL_GPUTexture *texture, SDL_GPUSampler *sampler,
+                           glm::vec4 bounds, uint32_t first_instance) {
+  DrawCommand &command = draw_commands.emplace_back();
+  command.pipeline = pipeline;
+  command.texture = texture;
+  command.sampler = sampler;
+  command.scissor = static_cast<uint32_t>(scissor_rects.size() - 1);
+  command.bounds = bounds;
+  command.vertex_uniform_size = 0;
+  command.fragment_uniform_size = 0;
+  command.instanced = true;
+  command.first_instance = first_instance;
+  command.instance_count =
+      static_cast<uint32_t>(queued_instances.size()) - first_instance;
+}
+
+// Texture slot the command would get in batch, -1 if it can't join it
+int Renderer::batch_slot(const DrawBatch &batch,
+                         const DrawCommand &command) const {
+  const DrawCommand &first = draw_commands[batch.first];
+  if (!command.instanced || !first.instanced) {
+    return same_draw_state(first, command) ? 0 : -1;
+  }
+  if (first.pipeline != command.pipeline) {
+    return -1;
+  }
+  if (!command.texture) {
+    return 0;
+  }
+  for (int slot = 0; slot < batch.slot_count; slot++) {
+    if (batch.slots[slot].texture == command.texture &&
+        batch.slots[slot].sampler == command.sampler) {
+      return slot;
+    }
+  }
+  return batch.slot_count < QUAD_TEXTURE_SLOTS ? batch.slot_count : -1;
+}
+
+// Groups the queued commands into batches of identical state. A command may
+// join an earlier batch in its scissor segment only if nothing queued since
+// overlaps it, so whatever Clay painted on top stays on top.
+void Renderer::batch_draw_commands() {
+  draw_batches.clear();
+  next_in_batch.assign(draw_commands.size(), UINT32_MAX);
+  size_t segment_start = 0;
+  for (uint32_t i = 0; i < draw_commands.size(); i++) {
+    DrawCommand &command = draw_commands[i];
+    if (!draw_batches.empty() &&
+        draw_batches.back().scissor != command.scissor) {
+      segment_start = draw_batches.size();
+    }
+
+    DrawBatch *target = nullptr;
+    int target_slot = 0;
+    int checked = 0;
+    bool blocked = false;
+    for (size_t b = draw_batches.size(); b-- > segment_start && !blocked;) {
+      DrawBatch &batch = draw_batches[b];
+      target_slot = batch_slot(batch, command);
+      if (target_slot >= 0) {
+        target = &batch;
+        break;
+      }
+      for (uint32_t c = batch.first; c != UINT32_MAX; c = next_in_batch[c]) {
+        if (bounds_overlap(draw_commands[c].bounds, command.bounds) ||
+            ++checked >= draw_batch_lookback) {
+          blocked = true;
+          break;
+        }
+      }
+    }
+
+    if (target) {
+      next_in_batch[target->last] = i;
+      target->last = i;
+    } else {
+      DrawBatch batch = {};
+      batch.first = i;
+      batch.last = i;
+      batch.scissor = command.scissor;
+      draw_batches.push_back(batch);
+      target = &draw_batches.back();
+      target_slot = 0;
+    }
+    if (command.instanced && command.texture) {
+      if (target_slot == target->slot_count) {
+        target->slots[target_slot].texture = command.texture;
+        target->slots[target_slot].sampler = command.sampler;
+        target->slot_count++;
+      }
+      for (uint32_t j = 0; j < command.instance_count; j++) {
+        queued_instances[command.first_instance + j].params.w =
+            static_cast<float>(target_slot);
+      }
+    }
+  }
 
-  // Bind vertex buffer
-  SDL_GPUBufferBinding vertex_buffer_bindings[1];
-  vertex_buffer_bindings[0].buffer = vertex_buffers["QUAD"];
-  vertex_buffer_bindings[0].offset = 0;
+  // Each instanced batch gets a contiguous run of the storage buffer
+  quad_instances.clear();
+  for (DrawBatch &batch : draw_batches) {
+    if (!draw_commands[batch.first].instanced) {
+      continue;
+    }
+    batch.first_instance = static_cast<uint32_t>(quad_instances.size());
+    for (uint32_t c = batch.first; c != UINT32_MAX; c = next_in_batch[c]) {
+      const DrawCommand &command = draw_commands[c];
+      const QuadInstance *first = &queued_instances[command.first_instance];
+      quad_instances.insert(quad_instances.end(), first,
+                            first + command.instance_count);
+    }
+    batch.instance_count =
+        static_cast<uint32_t>(quad_instances.size()) - batch.first_instance;
+  }
+}
 
-  SDL_BindGPUVertexBuffers(_render_pass, 0, vertex_buffer_bindings, 1);
+// Copy passes can't happen inside a render pass, so this ends the current
+// one. Cycling keeps the data earlier passes this frame read intact.
+bool Renderer::upload_frame_data() {
+  Uint32 size =
+      static_cast<Uint32>(quad_instances.size() * sizeof(QuadInstance));
+  if (size > quad_buffer_capacity) {
+    Uint32 capacity = SDL_max(quad_buffer_capacity, 64 * 1024u);
+    while (capacity < size) {
+      capacity *= 2;
+    }
+    // Released once the GPU is done with them
+    if (quad_buffer) {
+      SDL_ReleaseGPUBuffer(context.device, quad_buffer);
+      quad_buffer = nullptr;
+    }
+    if (quad_transfer_buffer) {
+      SDL_ReleaseGPUTransferBuffer(context.device, quad_transfer_buffer);
+      quad_transfer_buffer = nullptr;
+    }
+    quad_buffer_capacity = 0;
+
+    SDL_GPUBufferCreateInfo buffer_info{};
+    buffer_info.usage = SDL_GPU_BUFFERUSAGE_GRAPHICS_STORAGE_READ;
+    buffer_info.size = capacity;
+    quad_buffer = SDL_CreateGPUBuffer(context.device, &buffer_info);
+
+    SDL_GPUTransferBufferCreateInfo transfer_info{};
+    transfer_info.usage = SDL_GPU_TRANSFERBUFFERUSAGE_UPLOAD;
+    transfer_info.size = capacity;
+    quad_transfer_buffer =
+        SDL_CreateGPUTransferBuffer(context.device, &transfer_info);
+    if (!quad_buffer || !quad_transfer_buffer) {
+      SDL_Log("Failed to create quad instance buffer: %s", SDL_GetError());
+      return false;
+    }
+    SDL_SetGPUBufferName(context.device, quad_buffer, "Quad Instance Buffer");
+    quad_buffer_capacity = capacity;
+  }
 
-  // Bind index buffer
-  SDL_GPUBufferBinding index_buffer_bindings[1];
-  index_buffer_bindings[0].buffer = index_buffers["QUAD"];
-  index_buffer_bindings[0].offset = 0;
+  if (size > 0) {
+    void *data =
+        SDL_MapGPUTransferBuffer(context.device, quad_transfer_buffer, true);
+    SDL_memcpy(data, quad_instances.data(), size);
+    SDL_UnmapGPUTransferBuffer(context.device, quad_transfer_buffer);
+  }
 
-  SDL_BindGPUIndexBuffer(_render_pass, index_buffer_bindings,
-                         SDL_GPU_INDEXELEMENTSIZE_16BIT);
+  if (_render_pass) {
+    SDL_EndGPURenderPass(_render_pass);
+    _render_pass = nullptr;
+  }
+  SDL_GPUCopyPass *copy_pass = SDL_BeginGPUCopyPass(_command_buffer);
+  if (size > 0) {
+    SDL_GPUTransferBufferLocation location{};
+    location.transfer_buffer = quad_transfer_buffer;
+    location.offset = 0;
+    SDL_GPUBufferRegion region{};
+    region.buffer = quad_buffer;
+    region.offset = 0;
+    region.size = size;
+    SDL_UploadToGPUBuffer(copy_pass, &location, &region, true);
+  }
+  // Glyphs rasterized since the last flush
+  if (glyph_atlas.has_dirty_regions()) {
+    glyph_atlas.upload(copy_pass);
+  }
+  SDL_EndGPUCopyPass(copy_pass);
+  return true;
+}
 
-  // Uniforms and samplers
+bool Renderer::flush() {
+  if (draw_commands.empty()) {
+    return true;
+  }
+  batch_draw_commands();
+  frame_stats.commands += static_cast<uint32_t>(draw_commands.size());
+
+  // Minimized windows have no swapchain texture, nothing to draw into
+  bool can_draw = _swapchain_texture != nullptr;
+  if (can_draw &&
+      (!quad_instances.empty() || glyph_atlas.has_dirty_regions())) {
+    can_draw = upload_frame_data();
+  }
+  if (can_draw && !_render_pass) {
+    can_draw = begin_render_pass();
+  }
+
+  SDL_GPUGraphicsPipeline *bound_pipeline = nullptr;
+  SDL_GPUTextureSamplerBinding bound_slots[QUAD_TEXTURE_SLOTS] = {};
+  int bound_slot_count = 0;
+  // Uniforms only get pushed again when they differ from the last push
+  const DrawCommand *pushed_vertex = nullptr;
+  const DrawCommand *pushed_fragment = nullptr;
+  bool buffers_bound = false;
+
+  for (const DrawBatch &batch : draw_batches) {
+    if (!can_draw) {
+      break;
+    }
+    const SDL_Rect &scissor = scissor_rects[batch.scissor];
+    if (!scissor_applied || !same_rect(scissor, applied_scissor)) {
+      SDL_SetGPUScissor(_render_pass, &scissor);
+      applied_scissor = scissor;
+      scissor_applied = true;
+      frame_stats.scissor_changes++;
+    }
+
+    const DrawCommand &first = draw_commands[batch.first];
+    if (first.pipeline != bound_pipeline) {
+      SDL_BindGPUGraphicsPipeline(_render_pass, first.pipeline);
+      bound_pipeline = first.pipeline;
+      pushed_vertex = nullptr;
+      pushed_fragment = nullptr;
+      frame_stats.pipeline_binds++;
+    }
+    // Every pipeline draws the same quad
+    if (!buffers_bound) {
+      SDL_GPUBufferBinding vertex_buffer_bindings[1];
+      vertex_buffer_bindings[0].buffer = vertex_buffers["QUAD"];
+      vertex_buffer_bindings[0].offset = 0;
+      SDL_BindGPUVertexBuffers(_render_pass, 0, vertex_buffer_bindings, 1);
+
+      SDL_GPUBufferBinding index_buffer_bindings[1];
+      index_buffer_bindings[0].buffer = index_buffers["QUAD"];
+      index_buffer_bindings[0].offset = 0;
+      SDL_BindGPUIndexBuffer(_render_pass, index_buffer_bindings,
+                             SDL_GPU_INDEXELEMENTSIZE_16BIT);
+
+      if (!quad_instances.empty()) {
+        SDL_BindGPUVertexStorageBuffers(_render_pass, 0, &quad_buffer, 1);
+      }
+      buffers_bound = true;
+    }
+
+    // Instanced pipelines declare every slot, unused ones repeat the first
+    SDL_GPUTextureSamplerBinding slots[QUAD_TEXTURE_SLOTS];
+    int slot_count = 0;
+    if (first.instanced && batch.slot_count > 0) {
+      for (int slot = 0; slot < QUAD_TEXTURE_SLOTS; slot++) {
+        slots[slot] = batch.slots[slot < batch.slot_count ? slot : 0];
+      }
+      slot_count = QUAD_TEXTURE_SLOTS;
+    } else if (!first.instanced && first.texture) {
+      slots[0].texture = first.texture;
+      slots[0].sampler = first.sampler;
+      slot_count = 1;
+    }
+    if (slot_count > bound_slot_count ||
+        (slot_count > 0 &&
+         SDL_memcmp(slots, bound_slots, slot_count * sizeof(slots[0])) != 0)) {
+      SDL_BindGPUFragmentSamplers(_render_pass, 0, slots, slot_count);
+      SDL_memcpy(bound_slots, slots, slot_count * sizeof(slots[0]));
+      bound_slot_count = SDL_max(bound_slot_count, slot_count);
+      frame_stats.sampler_binds++;
+    }
+
+    if (first.instanced) {
+      QuadVertexUniformBuffer quad_uniforms = {};
+      quad_uniforms.projection_matrix = this->projection_matrix;
+      quad_uniforms.first_instance = batch.first_instance;
+      SDL_PushGPUVertexUniformData(_command_buffer, 0, &quad_uniforms,
+                                   sizeof(QuadVertexUniformBuffer));
+      frame_stats.uniform_pushes++;
+      SDL_DrawGPUIndexedPrimitives(_render_pass, 6, batch.instance_count, 0,
+                                   0, 0);
+      frame_stats.draws++;
+      frame_stats.instances += batch.instance_count;
+      continue;
+    }
+
+    for (uint32_t c = batch.first; c != UINT32_MAX; c = next_in_batch[c]) {
+      const DrawCommand &command = draw_commands[c];
+      if (!pushed_vertex ||
+          pushed_vertex->vertex_uniform_size != command.vertex_uniform_size ||
+          SDL_memcmp(pushed_vertex->vertex_uniforms, command.vertex_uniforms,
+                     command.vertex_uniform_size) != 0) {
+        SDL_PushGPUVertexUniformData(_command_buffer, 0,
+                                     command.vertex_uniforms,
+                                     command.vertex_uniform_size);
+        pushed_vertex = &command;
+        frame_stats.uniform_pushes++;
+      }
+      if (!pushed_fragment ||
+          pushed_fragment->fragment_uniform_size !=
+              command.fragment_uniform_size ||
+          SDL_memcmp(pushed_fragment->fragment_uniforms,
+                     command.fragment_uniforms,
+                     command.fragment_uniform_size) != 0) {
+        SDL_PushGPUFragmentUniformData(_command_buffer, 0,
+                                       command.fragment_uniforms,
+                                       command.fragment_uniform_size);
+        pushed_fragment = &command;
+        frame_stats.uniform_pushes++;
+      }
+
+      SDL_DrawGPUIndexedPrimitives(_render_pass, 6, 1, 0, 0, 0);
+      frame_stats.draws++;
+    }
+  }
+
+  // Later commands keep drawing under the current scissor
+  SDL_Rect scissor = scissor_rects.back();
+  scissor_rects.assign(1, scissor);
+  draw_commands.clear();
+  queued_instances.clear();
+  return can_draw;
+}
+
+// TODO: Add a queue_sprite_load() function to load in unavailable sprites
+bool Renderer::draw_sprite(std::string path, glm::vec2 translation,
+                           float rotation, glm::vec2 scale, glm::vec4 color) {
   // TODO: conditional jump valgrind error?
-  if (gpu_textures.find(path) == gpu_textures.end()) {
+  auto texture = gpu_textures.find(path);
+  if (texture == gpu_textures.end()) {
     SDL_Log("Sprite not loaded");
     SDL_Quit();
     return false;
   }
-  SDL_GPUTextureSamplerBinding fragment_sampler_bindings{};
-  fragment_sampler_bindings.texture = gpu_textures[path];
-  fragment_sampler_bindings.sampler = clamp_sampler;
-  SDL_BindGPUFragmentSamplers(_render_pass,
-                              0, // The binding point for the sampler
-                              &fragment_sampler_bindings,
-                              1 // Number of textures/samplers to bind
-  );
 
   // Calculate uniform values
   sprite_fragment_uniform_buffer.time = SDL_GetTicksNS() / 1e9f;
   sprite_fragment_uniform_buffer.modulate = color;
-  SDL_PushGPUFragmentUniformData(_command_buffer, 0,
-                                 &sprite_fragment_uniform_buffer,
-                                 sizeof(SpriteFragmentUniformBuffer));
 
   glm::mat4 model_matrix = glm::mat4(1.0f);
   model_matrix = glm::translate(model_matrix,
@@ -610,265 +1126,152 @@ bool Renderer::draw_sprite(std::string path, glm::vec2 translation,
   basic_vertex_uniform_buffer.mvp_matrix =
       this->projection_matrix * view_matrix * model_matrix;
 
-  SDL_PushGPUVertexUniformData(_command_buffer, 0, &basic_vertex_uniform_buffer,
-                               sizeof(BasicVertexUniformBuffer));
-
-  SDL_DrawGPUIndexedPrimitives(_render_pass, 6, 1, 0, 0,
-                               0); // TODO: Determine index count
-
+  // Covers the quad at any rotation
+  float extent = SDL_sqrtf(scale.x * scale.x + scale.y * scale.y) / 2.0f;
+  queue_draw(graphics_pipelines["SPRITE"], texture->second, clamp_sampler,
+             glm::vec4(translation.x - extent, translation.y - extent,
+                       translation.x + extent, translation.y + extent),
+             basic_vertex_uniform_buffer, sprite_fragment_uniform_buffer);
   return true;
 }
 
 bool Renderer::draw_color_rect(glm::vec2 position, glm::vec2 size,
                                glm::vec4 color, glm::vec4 corner_radius) {
-  // Bind graphics pipeline
-  SDL_BindGPUGraphicsPipeline(_render_pass, graphics_pipelines["COLOR_RECT"]);
-
-  // Bind vertex buffer
-  SDL_GPUBufferBinding vertex_buffer_bindings[1];
-  vertex_buffer_bindings[0].buffer = vertex_buffers["QUAD"];
-  vertex_buffer_bindings[0].offset = 0;
-
-  SDL_BindGPUVertexBuffers(_render_pass, 0, vertex_buffer_bindings, 1);
-
-  // Bind index buffer
-  SDL_GPUBufferBinding index_buffer_bindings[1];
-  index_buffer_bindings[0].buffer = index_buffers["QUAD"];
-  index_buffer_bindings[0].offset = 0;
-
-  SDL_BindGPUIndexBuffer(_render_pass, index_buffer_bindings,
-                         SDL_GPU_INDEXELEMENTSIZE_16BIT);
-
-  // Uniforms and samplers
-  // TODO: conditional jump valgrind error?
-  // SDL_GPUTextureSamplerBinding fragment_sampler_bindings{};
-  // fragment_sampler_bindings.texture = gpu_textures[path];
-  // fragment_sampler_bindings.sampler = clamp_sampler;
-  // SDL_BindGPUFragmentSamplers(_render_pass,
-  //                             0, // The binding point for the sampler
-  //                             &fragment_sampler_bindings,
-  //                             1 // Number of textures/samplers to bind
-  // );
-
-  // Calculate uniform values
-  // ui_rect_fragment_uniform_buffer.time = SDL_GetTicksNS() / 1e9f;
-  color_rect_fragment_uniform_buffer.modulate = color;
-  color_rect_fragment_uniform_buffer.corner_radii = glm::vec4(corner_radius);
-  color_rect_fragment_uniform_buffer.size =
-      glm::vec4(size.x, size.y, 0.0f, 0.0f);
-  SDL_PushGPUFragmentUniformData(_command_buffer, 0,
-                                 &color_rect_fragment_uniform_buffer,
-                                 sizeof(ColorRectFragmentUniformBuffer));
-
-  glm::mat4 model_matrix = glm::mat4(1.0f);
-
-  model_matrix = glm::translate(model_matrix,
-                                glm::vec3(position.x + size.x / 2.0f,
-                                          -(position.y + size.y / 2.0f), 0.0f));
-  model_matrix = glm::scale(model_matrix, glm::vec3(size, 1.0f));
-
-  basic_vertex_uniform_buffer.mvp_matrix =
-      this->projection_matrix * model_matrix;
-
-  SDL_PushGPUVertexUniformData(_command_buffer, 0, &basic_vertex_uniform_buffer,
-                               sizeof(BasicVertexUniformBuffer));
-
-  SDL_DrawGPUIndexedPrimitives(_render_pass, 6, 1, 0, 0,
-                               0); // TODO: Determine index count
-
+  uint32_t first_instance = static_cast<uint32_t>(queued_instances.size());
+  QuadInstance &instance = queued_instances.emplace_back();
+  instance.rect =
+      glm::vec4(position.x, -(position.y + size.y), size.x, size.y);
+  instance.color = color;
+  instance.corner_radii = corner_radius;
+  instance.uv_rect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+  instance.params = glm::vec4(0.0f);
+
+  queue_quads(graphics_pipelines["COLOR_RECT"], nullptr, nullptr,
+              glm::vec4(position.x, position.y, position.x + size.x,
+                        position.y + size.y),
+              first_instance);
   return true;
 };
 
 bool Renderer::draw_texture_rect(std::string path, glm::vec2 position,
                                  glm::vec2 size, glm::vec4 color,
                                  glm::vec4 corner_radius, bool tiling) {
-  // Bind graphics pipeline
-  SDL_BindGPUGraphicsPipeline(_render_pass, graphics_pipelines["TEXTURE_RECT"]);
-
-  // Bind vertex buffer
-  SDL_GPUBufferBinding vertex_buffer_bindings[1];
-  vertex_buffer_bindings[0].buffer = vertex_buffers["QUAD"];
-  vertex_buffer_bindings[0].offset = 0;
-
-  SDL_BindGPUVertexBuffers(_render_pass, 0, vertex_buffer_bindings, 1);
-
-  // Bind index buffer
-  SDL_GPUBufferBinding index_buffer_bindings[1];
-  index_buffer_bindings[0].buffer = index_buffers["QUAD"];
-  index_buffer_bindings[0].offset = 0;
-
-  SDL_BindGPUIndexBuffer(_render_pass, index_buffer_bindings,
-                         SDL_GPU_INDEXELEMENTSIZE_16BIT);
-
-  // Uniforms and samplers
-  // TODO: conditional jump valgrind error?
-  if (gpu_textures.find(path) == gpu_textures.end()) {
+  // Pyramids get sampled at the level closest to the on screen size
+  SDL_GPUTexture *texture = find_texture(path, size.x);
+  if (!texture) {
     SDL_Log("Sprite not loaded");
     SDL_Quit();
     return false;
   }
-  SDL_GPUTextureSamplerBinding fragment_sampler_bindings{};
-  fragment_sampler_bindings.texture = gpu_textures[path];
-  fragment_sampler_bindings.sampler = tiling ? wrap_sampler : clamp_sampler;
-  SDL_BindGPUFragmentSamplers(_render_pass,
-                              0, // The binding point for the sampler
-                              &fragment_sampler_bindings,
-                              1 // Number of textures/samplers to bind
-  );
-
-  // Calculate uniform values
-  texture_rect_fragment_uniform_buffer.modulate = color;
-  texture_rect_fragment_uniform_buffer.corner_radii = glm::vec4(corner_radius);
-  texture_rect_fragment_uniform_buffer.size =
-      glm::vec4(size.x, size.y, 0.0f, 0.0f);
-  texture_rect_fragment_uniform_buffer.tiling = tiling ? 1 : 0;
-
-  SDL_PushGPUFragmentUniformData(_command_buffer, 0,
-                                 &texture_rect_fragment_uniform_buffer,
-                                 sizeof(TextureRectFragmentUniformBuffer));
-
-  glm::mat4 model_matrix = glm::mat4(1.0f);
-
-  model_matrix = glm::translate(model_matrix,
-                                glm::vec3(position.x + size.x / 2.0f,
-                                          -(position.y + size.y / 2.0f), 0.0f));
-  model_matrix = glm::scale(model_matrix, glm::vec3(size, 1.0f));
-
-  basic_vertex_uniform_buffer.mvp_matrix =
-      this->projection_matrix * model_matrix;
-
-  SDL_PushGPUVertexUniformData(_command_buffer, 0, &basic_vertex_uniform_buffer,
-                               sizeof(BasicVertexUniformBuffer));
-
-  SDL_DrawGPUIndexedPrimitives(_render_pass, 6, 1, 0, 0,
-                               0); // TODO: Determine index count
 
+  uint32_t first_instance = static_cast<uint32_t>(queued_instances.size());
+  QuadInstance &instance = queued_instances.emplace_back();
+  instance.rect =
+      glm::vec4(position.x, -(position.y + size.y), size.x, size.y);
+  instance.color = color;
+  instance.corner_radii = corner_radius;
+  instance.uv_rect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+  instance.params = glm::vec4(tiling ? 1.0f : 0.0f, 0.0f, 0.0f, 0.0f);
+
+  queue_quads(graphics_pipelines["TEXTURE_RECT"], texture,
+              tiling ? wrap_sampler : clamp_sampler,
+              glm::vec4(position.x, position.y, position.x + size.x,
+                        position.y + size.y),
+              first_instance);
   return true;
 }
 
+// Queues the whole string as one glyph run, the TEXT pipeline draws it with
+// the other text in its batch in a single instanced call. Glyphs come from
+// the atlas at the bucket closest to the on screen pixel size.
 bool Renderer::draw_text(const char *text, int length, float point_size,
-                         glm::vec2 position, glm::vec4 color) {
-  // Bind graphics pipeline
-  SDL_BindGPUGraphicsPipeline(_render_pass, graphics_pipelines["TEXT"]);
-
-  // Bind vertex buffer
-  SDL_GPUBufferBinding vertex_buffer_bindings[1];
-  vertex_buffer_bindings[0].buffer = vertex_buffers["QUAD"];
-  vertex_buffer_bindings[0].offset = 0;
-
-  SDL_BindGPUVertexBuffers(_render_pass, 0, vertex_buffer_bindings, 1);
-
-  // Bind index buffer
-  SDL_GPUBufferBinding index_buffer_bindings[1];
-  index_buffer_bindings[0].buffer = index_buffers["QUAD"];
-  index_buffer_bindings[0].offset = 0;
-
-  SDL_BindGPUIndexBuffer(_render_pass, index_buffer_bindings,
-                         SDL_GPU_INDEXELEMENTSIZE_16BIT);
-
-  // Uniforms and samplers
-  // TODO: conditional jump valgrind error?
-  if (gpu_textures.find("FONT_GLYPH") == gpu_textures.end()) {
-    SDL_Log("Sprite not loaded");
-    SDL_Quit();
+                         glm::vec2 position, glm::vec4 color,
+                         uint16_t font_id) {
+  int bucket = GlyphAtlas::size_bucket(point_size * viewport_scale);
+  GlyphAtlas::LineMetrics metrics;
+  if (!glyph_atlas.line_metrics(font_id, bucket, metrics)) {
     return false;
   }
-  SDL_GPUTextureSamplerBinding fragment_sampler_bindings{};
-  fragment_sampler_bindings.texture = gpu_textures["FONT_GLYPH"];
-  fragment_sampler_bindings.sampler = clamp_sampler;
-  SDL_BindGPUFragmentSamplers(_render_pass,
-                              0, // The binding point for the sampler
-                              &fragment_sampler_bindings,
-                              1 // Number of textures/samplers to bind
-  );
-
-  float scalar = point_size / font_sample_point_size;
-
-  for (size_t i = 0; i < length; i++) {
-    if ((text[i] - 33) == -1) {
+  float scalar = point_size / bucket;
+  uint32_t first_instance = static_cast<uint32_t>(queued_instances.size());
+
+  float pen = position.x;
+  const char *next = text;
+  size_t remaining = static_cast<size_t>(length);
+  while (remaining > 0) {
+    Uint32 codepoint = SDL_StepUTF8(&next, &remaining);
+    const GlyphAtlas::Glyph *glyph =
+        glyph_atlas.find(font_id, bucket, codepoint);
+    if (!glyph) {
       continue;
     }
-    // Calculate uniform values
-    text_fragment_uniform_buffer.modulate = color;
-    float x = static_cast<float>((text[i] - 33) % 10) / 10.0f;
-    float y = static_cast<float>(static_cast<int>((text[i] - 33) / 10)) / 10.0f;
-    text_fragment_uniform_buffer.uv_rect = glm::vec4(x, y, x + 0.1f, y + 0.1f);
-    SDL_PushGPUFragmentUniformData(_command_buffer, 0,
-                                   &text_fragment_uniform_buffer,
-                                   sizeof(TextFragmentUniformBuffer));
-
-    glm::mat4 model_matrix = glm::mat4(1.0f);
-    model_matrix = glm::translate(
-        model_matrix,
-        glm::vec3(position.x + (i * glyph_size.x * scalar), -position.y, 0.0f));
-    model_matrix =
-        glm::scale(model_matrix, glm::vec3(glyph_size * scalar, 1.0f));
-    model_matrix = glm::translate(model_matrix, glm::vec3(0.5f, -0.5f, 0.0f));
-
-    glm::mat4 view_matrix = glm::mat4(1.0f);
-
-    text_vertex_uniform_buffer.mvp_matrix =
-        this->projection_matrix * view_matrix * model_matrix;
-    text_vertex_uniform_buffer.time = SDL_GetTicksNS() / 1e9f;
-    text_vertex_uniform_buffer.offset = static_cast<float>(i);
-
-    SDL_PushGPUVertexUniformData(_command_buffer, 0,
-                                 &text_vertex_uniform_buffer,
-                                 sizeof(TextVertexUniformBuffer));
-
-    SDL_DrawGPUIndexedPrimitives(_render_pass, 6, 1, 0, 0,
-                                 0); // TODO: Determine index count
+    if (glyph->size.x > 0.0f) {
+      glm::vec2 offset = glyph->offset * scalar;
+      glm::vec2 size = glyph->size * scalar;
+      QuadInstance &instance = queued_instances.emplace_back();
+      instance.rect = glm::vec4(pen + offset.x,
+                                -(position.y + offset.y + size.y), size.x,
+                                size.y);
+      instance.color = color;
+      instance.corner_radii = glm::vec4(0.0f);
+      instance.uv_rect = glyph->uv_rect;
+      instance.params = glm::vec4(0.0f);
+    }
+    pen += glyph->advance * scalar;
+  }
+  if (queued_instances.size() == first_instance) {
+    return true;
   }
 
+  queue_quads(graphics_pipelines["TEXT"], glyph_atlas.get_texture(),
+              clamp_sampler,
+              glm::vec4(position.x, position.y, pen,
+                        position.y + metrics.height * scalar),
+              first_instance);
   return true;
 }
 
+// Same advances draw_text uses, so layout matches what gets drawn
+glm::vec2 Renderer::measure_text(const char *text, int length,
+                                 float point_size, uint16_t font_id) {
+  int bucket = GlyphAtlas::size_bucket(point_size * viewport_scale);
+  GlyphAtlas::LineMetrics metrics;
+  if (!glyph_atlas.line_metrics(font_id, bucket, metrics)) {
+    return glm::vec2(0.0f);
+  }
+  float scalar = point_size / bucket;
+
+  float width = 0.0f;
+  const char *next = text;
+  size_t remaining = static_cast<size_t>(length);
+  while (remaining > 0) {
+    Uint32 codepoint = SDL_StepUTF8(&next, &remaining);
+    const GlyphAtlas::Glyph *glyph =
+        glyph_atlas.find(font_id, bucket, codepoint);
+    if (glyph) {
+      width += glyph->advance * scalar;
+    }
+  }
+  return glm::vec2(width, metrics.height * scalar);
+}
+
 bool Renderer::draw_arc(glm::vec2 position, float radius, float thickness,
                         float rotation, glm::vec4 color) {
-  // Bind graphics pipeline
-  SDL_BindGPUGraphicsPipeline(_render_pass, graphics_pipelines["ARC"]);
-
-  // Bind vertex buffer
-  SDL_GPUBufferBinding vertex_buffer_bindings[1];
-  vertex_buffer_bindings[0].buffer = vertex_buffers["QUAD"];
-  vertex_buffer_bindings[0].offset = 0;
-
-  SDL_BindGPUVertexBuffers(_render_pass, 0, vertex_buffer_bindings, 1);
-
-  // Bind index buffer
-  SDL_GPUBufferBinding index_buffer_bindings[1];
-  index_buffer_bindings[0].buffer = index_buffers["QUAD"];
-  index_buffer_bindings[0].offset = 0;
-
-  SDL_BindGPUIndexBuffer(_render_pass, index_buffer_bindings,
-                         SDL_GPU_INDEXELEMENTSIZE_16BIT);
-
-  // Calculate uniform values
-  arc_fragment_uniform_buffer.modulate = color;
-  arc_fragment_uniform_buffer.radius = radius;
-  arc_fragment_uniform_buffer.thickness = thickness;
-  SDL_PushGPUFragmentUniformData(_command_buffer, 0,
-                                 &arc_fragment_uniform_buffer,
-                                 sizeof(ArcFragmentUniformBuffer));
-
-  glm::mat4 model_matrix = glm::mat4(1.0f);
-
-  model_matrix =
-      glm::translate(model_matrix, glm::vec3(position.x, -position.y, 0.0f));
-  model_matrix = glm::scale(model_matrix, glm::vec3(radius, radius, 1.0f));
-  model_matrix = glm::rotate(model_matrix, glm::radians(rotation),
-                             glm::vec3(0.0f, 0.0f, 1.0f));
-  model_matrix = glm::translate(model_matrix, glm::vec3(0.5f, 0.5f, 0.0f));
-
-  basic_vertex_uniform_buffer.mvp_matrix =
-      this->projection_matrix * model_matrix;
-
-  SDL_PushGPUVertexUniformData(_command_buffer, 0, &basic_vertex_uniform_buffer,
-                               sizeof(BasicVertexUniformBuffer));
-
-  SDL_DrawGPUIndexedPrimitives(_render_pass, 6, 1, 0, 0,
-                               0); // TODO: Determine index count
-
+  uint32_t first_instance = static_cast<uint32_t>(queued_instances.size());
+  QuadInstance &instance = queued_instances.emplace_back();
+  instance.rect = glm::vec4(position.x, -position.y, radius, radius);
+  instance.color = color;
+  instance.corner_radii = glm::vec4(0.0f);
+  instance.uv_rect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+  instance.params =
+      glm::vec4(0.0f, thickness, glm::radians(rotation), 0.0f);
+
+  // The quad covers one quadrant around position, which one depends on the
+  // rotation
+  queue_quads(graphics_pipelines["ARC"], nullptr, nullptr,
+              glm::vec4(position.x - radius, position.y - radius,
+                        position.x + radius, position.y + radius),
+              first_instance);
   return true;
 }
 
@@ -879,7 +1282,7 @@ bool Renderer::begin_scissor_mode(glm::ivec2 pos, glm::ivec2 size) {
       size.x,
       size.y,
   };
-  SDL_SetGPUScissor(_render_pass, &rect);
+  scissor_rects.push_back(rect);
   return true;
 }
 
@@ -891,7 +1294,7 @@ bool Renderer::end_scissor_mode() {
       static_cast<int>(this->width),
       static_cast<int>(this->height),
   };
-  SDL_SetGPUScissor(_render_pass, &rect);
+  scissor_rects.push_back(rect);
   // SDL_SetGPUScissor(_render_pass, nullptr);
   return true;
 }
@@ -906,6 +1309,14 @@ bool Renderer::cleanup() {
     SDL_ReleaseGPUTexture(context.device, texture);
   }
 
+  for (auto &[path, pyramid] : texture_pyramids) {
+    for (SDL_GPUTexture *texture : pyramid.levels) {
+      if (texture) {
+        SDL_ReleaseGPUTexture(context.device, texture);
+      }
+    }
+  }
+
   for (auto &[name, buffer] : vertex_buffers) {
     SDL_ReleaseGPUBuffer(context.device, buffer);
   }
@@ -914,6 +1325,14 @@ bool Renderer::cleanup() {
     SDL_ReleaseGPUBuffer(context.device, buffer);
   }
 
+  if (quad_buffer) {
+    SDL_ReleaseGPUBuffer(context.device, quad_buffer);
+  }
+  if (quad_transfer_buffer) {
+    SDL_ReleaseGPUTransferBuffer(context.device, quad_transfer_buffer);
+  }
+  glyph_atlas.cleanup();
+
   SDL_ReleaseGPUSampler(context.device, clamp_sampler);
 
   SDL_ReleaseWindowFromGPUDevice(context.device, context.window);
@@ -0,0 +1,53 @@
+#include "selection_set.hpp"
+
+void SelectionSet::push_back(bool selected) {
+  if (bit_count % 64 == 0) {
+    words.push_back(0);
+  }
+  bit_count++;
+  set(bit_count - 1, selected);
+}
+
+void SelectionSet::erase(size_t index) {
+  if (test(index)) {
+    selected_count--;
+  }
+  // Bits above index in its word move down one, then every later word does
+  // too with the lowest bit of the next word carried in at the top
+  size_t word = index / 64;
+  uint64_t below = (uint64_t(1) << (index % 64)) - 1;
+  uint64_t above = index % 64 == 63 ? 0 : words[word] >> (index % 64 + 1);
+  words[word] = (words[word] & below) | (above << (index % 64));
+  for (size_t i = word; i < words.size(); i++) {
+    if (i > word) {
+      words[i] >>= 1;
+    }
+    if (i + 1 < words.size()) {
+      words[i] |= (words[i + 1] & 1) << 63;
+    }
+  }
+  bit_count--;
+  if (bit_count % 64 == 0) {
+    words.pop_back();
+  }
+}
+
+void SelectionSet::clear() {
+  words.clear();
+  bit_count = 0;
+  selected_count = 0;
+}
+
+void SelectionSet::set(size_t index, bool selected) {
+  uint64_t &word = words[index / 64];
+  uint64_t bit = uint64_t(1) << (index % 64);
+  if (bool(word & bit) == selected) {
+    return;
+  }
+  word ^= bit;
+  if (selected) {
+    selected_count++;
+  } else {
+    selected_count--;
+  }
+}
@@ -0,0 +1,234 @@
+#include "selection_sidecar.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "SDL3/SDL_log.h"
+
+#include "config.hpp"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+static const char SIDECAR_MAGIC[8] = {'S', 'R', 'S', 'E', 'L', 'E', 'C', '1'};
+
+struct SidecarHeader {
+  char magic[8];
+  uint32_t capacity; // Bits in the bitset that follows, a multiple of 8
+  uint32_t reserved;
+};
+
+static const uint32_t initial_capacity = 4096;
+
+static bool sync_file(FILE *file) {
+  if (fflush(file) != 0) {
+    return false;
+  }
+#ifdef _WIN32
+  return _commit(_fileno(file)) == 0;
+#else
+  return fsync(fileno(file)) == 0;
+#endif
+}
+
+SelectionSidecar::~SelectionSidecar() { close(); }
+
+bool SelectionSidecar::open(const std::filesystem::path &folder) {
+  close();
+  this->folder = folder;
+  path = folder / ".selection";
+  capacity = 0;
+  bits.clear();
+  names.clear();
+  ids.clear();
+
+  std::ifstream in(path, std::ios::binary);
+  std::vector<char> contents((std::istreambuf_iterator<char>(in)),
+                             std::istreambuf_iterator<char>());
+  in.close();
+
+  // Read back whatever is valid, a torn name at the end (crash mid-write)
+  // gets dropped and the file rewritten without it
+  SidecarHeader header;
+  bool valid = contents.size() >= sizeof(header);
+  if (valid) {
+    memcpy(&header, contents.data(), sizeof(header));
+    valid = memcmp(header.magic, SIDECAR_MAGIC, sizeof(header.magic)) == 0 &&
+            header.capacity % 8 == 0 &&
+            contents.size() >= sizeof(header) + header.capacity / 8;
+  }
+  if (!valid) {
+    return rewrite(initial_capacity);
+  }
+
+  capacity = header.capacity;
+  const uint8_t *data = reinterpret_cast<const uint8_t *>(contents.data());
+  bits.assign(data + sizeof(header), data + sizeof(header) + capacity / 8);
+  size_t offset = sizeof(header) + capacity / 8;
+  bool torn = false;
+  while (offset < contents.size()) {
+    uint32_t length;
+    if (offset + sizeof(length) > contents.size()) {
+      torn = true;
+      break;
+    }
+    memcpy(&length, data + offset, sizeof(length));
+    offset += sizeof(length);
+    if (offset + length > contents.size() || names.size() >= capacity) {
+      torn = true;
+      break;
+    }
+    std::string name(contents.data() + offset, length);
+    offset += length;
+    ids.emplace(name, static_cast<uint32_t>(names.size()));
+    names.push_back(std::move(name));
+  }
+  if (torn) {
+    return rewrite(capacity);
+  }
+
+  file = fopen(path.string().c_str(), "r+b");
+  if (!file) {
+    SDL_Log("WARNING: selections in %s won't be saved", path.string().c_str());
+    return false;
+  }
+  last_sync = std::chrono::steady_clock::now();
+  SDL_Log("Selection sidecar %s: %zu photos", path.string().c_str(),
+          names.size());
+  return true;
+}
+
+// Writes the whole sidecar next to the old one and renames it over, so the
+// selections on disk are never half written
+bool SelectionSidecar::rewrite(uint32_t capacity) {
+  if (file) {
+    fclose(file);
+    file = nullptr;
+  }
+  this->capacity = capacity;
+  bits.resize(capacity / 8, 0);
+
+  std::filesystem::path temporary_path = path;
+  temporary_path += ".tmp";
+  FILE *out = fopen(temporary_path.string().c_str(), "wb");
+  if (!out) {
+    SDL_Log("WARNING: selections in %s won't be saved", path.string().c_str());
+    return false;
+  }
+  SidecarHeader header = {};
+  memcpy(header.magic, SIDECAR_MAGIC, sizeof(header.magic));
+  header.capacity = capacity;
+  bool written = fwrite(&header, sizeof(header), 1, out) == 1 &&
+                 fwrite(bits.data(), 1, bits.size(), out) == bits.size();
+  for (size_t i = 0; i < names.size() && written; i++) {
+    uint32_t length = static_cast<uint32_t>(names[i].size());
+    written = fwrite(&length, sizeof(length), 1, out) == 1 &&
+              fwrite(names[i].data(), 1, length, out) == length;
+  }
+  written = sync_file(out) && written;
+  fclose(out);
+
+  std::error_code error;
+  if (written) {
+    std::filesystem::rename(temporary_path, path, error);
+  }
+  if (!written || error) {
+    SDL_Log("WARNING: writing selections to %s failed", path.string().c_str());
+    std::filesystem::remove(temporary_path, error);
+    return false;
+  }
+  file = fopen(path.string().c_str(), "r+b");
+  dirty = false;
+  last_sync = std::chrono::steady_clock::now();
+  return file != nullptr;
+}
+
+void SelectionSidecar::close() {
+  if (!file) {
+    return;
+  }
+  if (dirty) {
+    sync();
+  }
+  fclose(file);
+  file = nullptr;
+}
+
+void SelectionSidecar::remove() {
+  close();
+  std::error_code error;
+  std::filesystem::remove(path, error);
+  bits.clear();
+  names.clear();
+  ids.clear();
+}
+
+uint32_t SelectionSidecar::find_or_add(const std::filesystem::path &file_path) {
+  std::filesystem::path relative = file_path.lexically_relative(folder);
+  std::string name =
+      (relative.parent_path() / relative.stem()).generic_string();
+  auto it = ids.find(name);
+  if (it != ids.end()) {
+    return it->second;
+  }
+
+  uint32_t id = static_cast<uint32_t>(names.size());
+  ids.emplace(name, id);
+  names.push_back(name);
+  if (id >= capacity) {
+    // Rewrite includes the new name
+    rewrite(capacity * 2);
+    return id;
+  }
+  if (file) {
+    uint32_t length = static_cast<uint32_t>(name.size());
+    fseek(file, 0, SEEK_END);
+    fwrite(&length, sizeof(length), 1, file);
+    fwrite(name.data(), 1, length, file);
+    fflush(file);
+    dirty = true;
+  }
+  return id;
+}
+
+bool SelectionSidecar::is_selected(uint32_t id) const {
+  return id / 8 < bits.size() && (bits[id / 8] >> (id % 8)) & 1;
+}
+
+void SelectionSidecar::set_selected(uint32_t id, bool selected) {
+  if (id / 8 >= bits.size()) {
+    return;
+  }
+  uint8_t &byte = bits[id / 8];
+  byte = selected ? byte | (1u << (id % 8)) : byte & ~(1u << (id % 8));
+  // In the page cache right away, so it survives the app crashing
+  if (file) {
+    fseek(file, sizeof(SidecarHeader) + id / 8, SEEK_SET);
+    fputc(byte, file);
+    fflush(file);
+    dirty = true;
+  }
+}
+
+void SelectionSidecar::sync_if_due() {
+  if (!dirty) {
+    return;
+  }
+  auto now = std::chrono::steady_clock::now();
+  if (now - last_sync >=
+      std::chrono::milliseconds(selection_sync_interval_ms)) {
+    sync();
+  }
+}
+
+void SelectionSidecar::sync() {
+  if (file && !sync_file(file)) {
+    SDL_Log("WARNING: syncing %s failed", path.string().c_str());
+  }
+  dirty = false;
+  last_sync = std::chrono::steady_clock::now();
+}
@@ -4,15 +4,12 @@ layout(location = 1) in vec2 v_texcoord;
 layout(location = 0) out vec4 FragColor;
 // TODO: Rename this bullshit to arc
 // TODO: Add graduated thickness
-layout(std140, set = 3, binding = 0) uniform UniformBlock {
-    vec4 modulate;
-    float radius;
-    float thickness;
-    float padding1;
-    float padding2;
-};
+layout(location = 2) flat in vec4 size;
+layout(location = 5) flat in vec4 params;
 
 void main() {
+    float radius = size.x;
+    float thickness = params.y;
     vec2 pos = v_texcoord * radius;
     float smoothing = 1.0f;
     float alpha = 1.0f;
@@ -27,6 +24,6 @@ void main() {
         float end = radius - thickness + smoothing / 2.0f;
         alpha = smoothstep(start, end, dist);
     }
-    vec4 color = v_color * modulate;
+    vec4 color = v_color;
     FragColor = vec4(color.rgb, alpha);
 }
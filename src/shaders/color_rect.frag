@@ -3,11 +3,8 @@ layout(location = 0) in vec4 v_color;
 layout(location = 1) in vec2 v_texcoord;
 layout(location = 0) out vec4 FragColor;
 
-layout(std140, set = 3, binding = 0) uniform UniformBlock {
-    vec4 size;
-    vec4 modulate;
-    vec4 corner_radii;
-};
+layout(location = 2) flat in vec4 size;
+layout(location = 3) flat in vec4 corner_radii;
 
 void main() {
     vec2 pos = vec2(v_texcoord.x * size.x, v_texcoord.y * size.y);
@@ -38,6 +35,6 @@ void main() {
     if (pos.x > size.x - radius && pos.y > size.y - radius) {
         alpha = 1.0f - smoothstep(radius - smoothing / 2.0f, radius + smoothing / 2.0f, dist);
     }
-    vec4 color = v_color * modulate;
+    vec4 color = v_color;
     FragColor = vec4(color.rgb, alpha);
 }
@@ -0,0 +1,48 @@
+#version 460
+
+layout(location = 0) in vec3 a_position;
+layout(location = 1) in vec4 a_color;
+layout(location = 2) in vec2 a_texcoord;
+
+layout(location = 0) out vec4 v_color;
+layout(location = 1) out vec2 v_texcoord;
+layout(location = 2) flat out vec4 v_size;
+layout(location = 3) flat out vec4 v_corner_radii;
+layout(location = 4) flat out vec4 v_uv_rect;
+layout(location = 5) flat out vec4 v_params;
+
+// Matches QuadInstance in renderer.hpp
+struct Quad {
+    vec4 rect;
+    vec4 color;
+    vec4 corner_radii;
+    vec4 uv_rect;
+    vec4 params;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer QuadBuffer {
+    Quad quads[];
+};
+
+layout(std140, set = 1, binding = 0) uniform UniformBlock {
+    mat4 projection_matrix;
+    uint first_instance;
+};
+
+void main()
+{
+    // gl_InstanceIndex doesn't include the batch offset on every backend
+    Quad quad = quads[first_instance + gl_InstanceIndex];
+    // Unit square with its bottom left corner on rect.xy, rotated around it
+    vec2 local = (a_position.xy + 0.5f) * quad.rect.zw;
+    float s = sin(quad.params.z);
+    float c = cos(quad.params.z);
+    vec2 position = quad.rect.xy + vec2(local.x * c - local.y * s, local.x * s + local.y * c);
+    gl_Position = projection_matrix * vec4(position, 0.0f, 1.0f);
+    v_color = a_color * quad.color;
+    v_texcoord = a_texcoord;
+    v_size = vec4(quad.rect.zw, 0.0f, 0.0f);
+    v_corner_radii = quad.corner_radii;
+    v_uv_rect = quad.uv_rect;
+    v_params = quad.params;
+}
@@ -0,0 +1,17 @@
+#version 460
+layout(location = 0) in vec4 v_color;
+layout(location = 1) in vec2 v_texcoord;
+layout(location = 4) flat in vec4 uv_rect;
+layout(location = 0) out vec4 FragColor;
+
+layout(set = 2, binding = 0) uniform sampler2D myTextureSampler;
+
+void main() {
+    vec2 sampled_uv = uv_rect.xy + v_texcoord * (uv_rect.zw - uv_rect.xy);
+    // Alpha is the distance to the outline, 0.5 on it
+    float distance = texture(myTextureSampler, sampled_uv).a;
+    // Edge about a pixel wide at any scale
+    float edge = max(fwidth(distance) * 0.5, 0.001);
+    float alpha = smoothstep(0.5 - edge, 0.5 + edge, distance);
+    FragColor = vec4(v_color.rgb, alpha * v_color.a);
+}
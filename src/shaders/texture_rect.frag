@@ -3,16 +3,39 @@ layout(location = 0) in vec4 v_color;
 layout(location = 1) in vec2 v_texcoord;
 layout(location = 0) out vec4 FragColor;
 
-layout(set = 2, binding = 0) uniform sampler2D myTextureSampler;
+layout(location = 2) flat in vec4 size;
+layout(location = 3) flat in vec4 corner_radii;
+layout(location = 4) flat in vec4 uv_rect;
+layout(location = 5) flat in vec4 params;
 
-layout(std140, set = 3, binding = 0) uniform UniformBlock {
-    vec4 size;
-    vec4 modulate;
-    vec4 corner_radii;
-    int tiling;
-};
+// One per texture slot of a batch, QUAD_TEXTURE_SLOTS in renderer.hpp
+layout(set = 2, binding = 0) uniform sampler2D texture_slot_0;
+layout(set = 2, binding = 1) uniform sampler2D texture_slot_1;
+layout(set = 2, binding = 2) uniform sampler2D texture_slot_2;
+layout(set = 2, binding = 3) uniform sampler2D texture_slot_3;
+layout(set = 2, binding = 4) uniform sampler2D texture_slot_4;
+layout(set = 2, binding = 5) uniform sampler2D texture_slot_5;
+layout(set = 2, binding = 6) uniform sampler2D texture_slot_6;
+layout(set = 2, binding = 7) uniform sampler2D texture_slot_7;
+
+vec4 sample_slot(int slot, vec2 uv) {
+    // Derivatives from outside the branches, every fragment of a quad picks
+    // the same slot anyway
+    vec2 dx = dFdx(uv);
+    vec2 dy = dFdy(uv);
+    if (slot == 0) return textureGrad(texture_slot_0, uv, dx, dy);
+    if (slot == 1) return textureGrad(texture_slot_1, uv, dx, dy);
+    if (slot == 2) return textureGrad(texture_slot_2, uv, dx, dy);
+    if (slot == 3) return textureGrad(texture_slot_3, uv, dx, dy);
+    if (slot == 4) return textureGrad(texture_slot_4, uv, dx, dy);
+    if (slot == 5) return textureGrad(texture_slot_5, uv, dx, dy);
+    if (slot == 6) return textureGrad(texture_slot_6, uv, dx, dy);
+    return textureGrad(texture_slot_7, uv, dx, dy);
+}
 
 void main() {
+    bool tiling = params.x > 0.5f;
+    int slot = int(params.w);
     vec2 pos = vec2(v_texcoord.x * size.x, v_texcoord.y * size.y);
     float smoothing = 1.0f;
     float max_radius = min(size.x, size.y) / 2.0f;
@@ -41,13 +64,12 @@ void main() {
     if (pos.x > size.x - radius && pos.y > size.y - radius) {
         alpha = 1.0f - smoothstep(radius - smoothing / 2.0f, radius + smoothing / 2.0f, dist);
     }
-    vec4 color = v_color * modulate;
     vec2 sample_uv;
-    if (tiling == 1) {
+    if (tiling) {
         sample_uv = v_texcoord * size.xy / 16.0f;
     } else {
-        sample_uv = v_texcoord;
+        sample_uv = uv_rect.xy + v_texcoord * (uv_rect.zw - uv_rect.xy);
     }
-    vec4 albedo = texture(myTextureSampler, sample_uv);
-    FragColor = vec4(albedo.rgb * v_color.rgb * modulate.rgb, albedo.a * v_color.a * modulate.a * alpha);
+    vec4 albedo = sample_slot(slot, sample_uv);
+    FragColor = vec4(albedo.rgb * v_color.rgb, albedo.a * v_color.a * alpha);
 }
@@ -0,0 +1,91 @@
+#include "texture_residency.hpp"
+
+TextureResidency::TextureResidency(size_t budget_bytes)
+    : budget_bytes(budget_bytes) {}
+
+void TextureResidency::set_budget(size_t budget_bytes) {
+  this->budget_bytes = budget_bytes;
+}
+
+void TextureResidency::begin_frame() { frame++; }
+
+void TextureResidency::add(size_t key, size_t bytes) {
+  auto it = entries.find(key);
+  if (it != entries.end()) {
+    stats.resident_bytes -= it->second->bytes;
+    lru.erase(it->second);
+    entries.erase(it);
+  }
+  lru.push_front(Entry{
+      .key = key,
+      .bytes = bytes,
+      .last_drawn_frame = frame,
+      .drawn = false,
+  });
+  entries[key] = lru.begin();
+  stats.resident_bytes += bytes;
+  stats.resident_count = entries.size();
+}
+
+bool TextureResidency::touch(size_t key) {
+  auto it = entries.find(key);
+  if (it == entries.end()) {
+    return false;
+  }
+  // Once per residency, counting every frame would just measure how long
+  // things stay on screen
+  if (!it->second->drawn) {
+    it->second->drawn = true;
+    stats.hits++;
+  }
+  it->second->last_drawn_frame = frame;
+  lru.splice(lru.begin(), lru, it->second);
+  return true;
+}
+
+void TextureResidency::evict(std::vector<size_t> &evicted) {
+  // Anything drawn this frame sits at the front, so stop at the first one.
+  // The budget can be exceeded if the visible thumbnails alone don't fit.
+  while (stats.resident_bytes > budget_bytes && !lru.empty() &&
+         lru.back().last_drawn_frame != frame) {
+    const Entry &entry = lru.back();
+    evicted.push_back(entry.key);
+    stats.resident_bytes -= entry.bytes;
+    stats.evictions++;
+    entries.erase(entry.key);
+    lru.pop_back();
+  }
+  stats.resident_count = entries.size();
+}
+
+void TextureResidency::remove(size_t key) {
+  auto it = entries.find(key);
+  if (it == entries.end()) {
+    return;
+  }
+  stats.resident_bytes -= it->second->bytes;
+  lru.erase(it->second);
+  entries.erase(it);
+  stats.resident_count = entries.size();
+}
+
+void TextureResidency::erase_range(size_t first_key, size_t count) {
+  for (size_t key = first_key; key < first_key + count; key++) {
+    remove(key);
+  }
+  // Keys change, so the map gets rebuilt from the list
+  entries.clear();
+  for (auto it = lru.begin(); it != lru.end(); ++it) {
+    if (it->key >= first_key + count) {
+      it->key -= count;
+    }
+    entries[it->key] = it;
+  }
+}
+
+void TextureResidency::clear() {
+  lru.clear();
+  entries.clear();
+  stats.resident_bytes = 0;
+  stats.resident_count = 0;
+}
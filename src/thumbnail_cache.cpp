@@ -0,0 +1,412 @@
+#include "thumbnail_cache.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+
+#include "SDL3/SDL_log.h"
+
+#include "config.hpp"
+
+static const char INDEX_MAGIC[8] = {'S', 'R', 'T', 'H', 'U', 'M', 'B', '1'};
+
+// Fixed part of an index record, followed by path_length bytes of path. A
+// record without pixels (width 0) removes the entry instead.
+struct IndexRecord {
+  uint64_t file_size;
+  int64_t mtime;
+  uint64_t offset;
+  uint32_t target_width;
+  uint32_t width;
+  uint32_t height;
+  uint32_t path_length;
+};
+
+// FNV-1a, stable across runs unlike std::hash
+static uint64_t hash_string(const std::string &string) {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (unsigned char c : string) {
+    hash ^= c;
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+static std::filesystem::path cache_root() {
+  const char *xdg_cache_home = getenv("XDG_CACHE_HOME");
+  if (xdg_cache_home && xdg_cache_home[0] != '\0') {
+    return std::filesystem::path(xdg_cache_home) / "software-renderer";
+  }
+  const char *home = getenv("HOME");
+  if (home && home[0] != '\0') {
+    return std::filesystem::path(home) / ".cache" / "software-renderer";
+  }
+  return std::filesystem::temp_directory_path() / "software-renderer";
+}
+
+// Hashing instead of building a string key keeps lookups allocation free
+static uint64_t entry_key(const std::filesystem::path &file,
+                          int target_width) {
+  const std::filesystem::path::string_type &native = file.native();
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (auto c : native) {
+    hash ^= static_cast<uint64_t>(c);
+    hash *= 0x100000001b3ull;
+  }
+  return hash ^ (uint64_t(target_width) * 0x9e3779b97f4a7c15ull);
+}
+
+ThumbnailCache::~ThumbnailCache() { close(); }
+
+bool ThumbnailCache::get_stamp(const std::filesystem::path &file,
+                               FileStamp &stamp) {
+  std::error_code error;
+  uint64_t size = std::filesystem::file_size(file, error);
+  if (error) {
+    return false;
+  }
+  std::filesystem::file_time_type mtime =
+      std::filesystem::last_write_time(file, error);
+  if (error) {
+    return false;
+  }
+  stamp.size = size;
+  stamp.mtime = mtime.time_since_epoch().count();
+  return true;
+}
+
+bool ThumbnailCache::open(const std::filesystem::path &folder) {
+  close();
+  std::lock_guard<std::mutex> lock(mutex);
+
+  std::error_code error;
+  std::filesystem::path absolute_folder =
+      std::filesystem::weakly_canonical(folder, error);
+  if (error) {
+    absolute_folder = folder;
+  }
+  char folder_hash[17];
+  snprintf(folder_hash, sizeof(folder_hash), "%016llx",
+           static_cast<unsigned long long>(
+               hash_string(absolute_folder.string())));
+  std::filesystem::path directory = cache_root() / "thumbnails" / folder_hash;
+  std::filesystem::create_directories(directory, error);
+  if (error) {
+    SDL_Log("Failed to create thumbnail cache %s: %s", directory.c_str(),
+            error.message().c_str());
+    return false;
+  }
+
+  pack_path = directory / "thumbnails.pack";
+  std::filesystem::path index_path = directory / "thumbnails.idx";
+  pack_size = std::filesystem::file_size(pack_path, error);
+  if (error) {
+    pack_size = 0;
+  }
+
+  // Replay the index, later records win. A torn record at the end (crash
+  // mid-write) or one pointing past the pack is simply ignored.
+  bool valid_index = false;
+  std::ifstream index_in(index_path, std::ios::binary);
+  char magic[sizeof(INDEX_MAGIC)];
+  if (index_in.read(magic, sizeof(magic)) &&
+      memcmp(magic, INDEX_MAGIC, sizeof(magic)) == 0) {
+    valid_index = true;
+    IndexRecord record;
+    std::string path;
+    while (index_in.read(reinterpret_cast<char *>(&record), sizeof(record))) {
+      path.resize(record.path_length);
+      if (!index_in.read(path.data(), record.path_length)) {
+        break;
+      }
+      std::filesystem::path file(path);
+      uint64_t key = entry_key(file, record.target_width);
+      if (record.width == 0) {
+        auto it = entries.find(key);
+        if (it != entries.end() && it->second.path == file) {
+          entries.erase(it);
+        }
+        continue;
+      }
+      uint64_t bytes = uint64_t(record.width) * record.height * 4;
+      if (record.offset + bytes > pack_size) {
+        continue;
+      }
+      entries[key] = Entry{
+          .path = std::move(file),
+          .stamp = {.size = record.file_size, .mtime = record.mtime},
+          .target_width = record.target_width,
+          .width = record.width,
+          .height = record.height,
+          .offset = record.offset,
+      };
+    }
+  }
+  index_in.close();
+
+  if (valid_index) {
+    // Replaced thumbnails and ones prune() removed, nothing here touches the
+    // photos themselves since the folder can be on a slow share
+    uint64_t live_bytes = 0;
+    for (const auto &[key, entry] : entries) {
+      live_bytes += uint64_t(entry.width) * entry.height * 4;
+    }
+    uint64_t dead_bytes = pack_size > live_bytes ? pack_size - live_bytes : 0;
+    if (dead_bytes >= thumbnail_cache_compact_bytes &&
+        dead_bytes * 4 >= pack_size) {
+      valid_index = compact(index_path);
+    }
+  }
+
+  if (valid_index) {
+    index_stream.open(index_path, std::ios::binary | std::ios::app);
+    pack_stream.open(pack_path, std::ios::binary | std::ios::app);
+  } else {
+    // Missing or from an older version, start over
+    index_stream.open(index_path, std::ios::binary | std::ios::trunc);
+    index_stream.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    pack_stream.open(pack_path, std::ios::binary | std::ios::trunc);
+    pack_size = 0;
+  }
+  if (!index_stream.is_open() || !pack_stream.is_open()) {
+    SDL_Log("Failed to open thumbnail cache in %s", directory.c_str());
+    index_stream.close();
+    pack_stream.close();
+    entries.clear();
+    return false;
+  }
+
+  SDL_Log("Thumbnail cache %s: %zu entries", directory.c_str(),
+          entries.size());
+  return remap();
+}
+
+void ThumbnailCache::close() {
+  std::lock_guard<std::mutex> lock(mutex);
+  pack_stream.close();
+  index_stream.close();
+  entries.clear();
+  mappings.clear();
+  pack_size = 0;
+}
+
+bool ThumbnailCache::remap() {
+  pack_stream.flush();
+  if (pack_size == 0) {
+    return true;
+  }
+  std::unique_ptr<MappedFile> mapping = std::make_unique<MappedFile>();
+  if (!mapping->open_stable(pack_path)) {
+    return false;
+  }
+  std::erase_if(mappings, [](const Mapping &old) { return old.users == 0; });
+  mappings.push_back(Mapping{
+      .file = std::move(mapping),
+      .id = next_mapping_id++,
+      .users = 0,
+  });
+  return true;
+}
+
+// Rewrites the pack with only the entries still in use. The old index is
+// removed before anything gets replaced, a crash part way leaves no index and
+// the cache starts over instead of pointing into the wrong pack.
+bool ThumbnailCache::compact(const std::filesystem::path &index_path) {
+  MappedFile old_pack;
+  std::filesystem::path new_pack_path = pack_path;
+  new_pack_path += ".tmp";
+  std::filesystem::path new_index_path = index_path;
+  new_index_path += ".tmp";
+  std::ofstream new_pack(new_pack_path, std::ios::binary | std::ios::trunc);
+  std::ofstream new_index(new_index_path, std::ios::binary | std::ios::trunc);
+  bool written = old_pack.open_stable(pack_path);
+  new_index.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+
+  uint64_t offset = 0;
+  for (auto it = entries.begin(); written && it != entries.end(); ++it) {
+    Entry &entry = it->second;
+    std::string path = entry.path.string();
+    uint64_t bytes = uint64_t(entry.width) * entry.height * 4;
+    IndexRecord record{
+        .file_size = entry.stamp.size,
+        .mtime = entry.stamp.mtime,
+        .offset = offset,
+        .target_width = entry.target_width,
+        .width = entry.width,
+        .height = entry.height,
+        .path_length = static_cast<uint32_t>(path.size()),
+    };
+    new_pack.write(
+        reinterpret_cast<const char *>(old_pack.data() + entry.offset), bytes);
+    new_index.write(reinterpret_cast<const char *>(&record), sizeof(record));
+    new_index.write(path.data(), path.size());
+    entry.offset = offset;
+    offset += bytes;
+    written = new_pack.good() && new_index.good();
+  }
+  new_pack.close();
+  new_index.close();
+  old_pack.close();
+  written = written && !new_pack.fail() && !new_index.fail();
+
+  std::error_code error;
+  if (written) {
+    std::filesystem::remove(index_path, error);
+  }
+  if (written && !error) {
+    std::filesystem::rename(new_pack_path, pack_path, error);
+  }
+  if (written && !error) {
+    std::filesystem::rename(new_index_path, index_path, error);
+  }
+  if (!written || error) {
+    SDL_Log("WARNING: compacting thumbnail cache %s failed",
+            pack_path.c_str());
+    std::filesystem::remove(new_pack_path, error);
+    std::filesystem::remove(new_index_path, error);
+    entries.clear();
+    return false;
+  }
+  SDL_Log("Thumbnail cache compacted from %llu to %llu MB",
+          static_cast<unsigned long long>(pack_size / (1024 * 1024)),
+          static_cast<unsigned long long>(offset / (1024 * 1024)));
+  pack_size = offset;
+  return true;
+}
+
+bool ThumbnailCache::lookup(const std::filesystem::path &file,
+                            int target_width, const FileStamp &stamp,
+                            CachedThumbnail &thumbnail) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = entries.find(entry_key(file, target_width));
+  if (it == entries.end()) {
+    return false;
+  }
+  // Another path with the same hash counts as a miss
+  const Entry &entry = it->second;
+  if (entry.path.native() != file.native() ||
+      entry.stamp.size != stamp.size || entry.stamp.mtime != stamp.mtime) {
+    return false;
+  }
+
+  // Stored after the last mapping was made
+  uint64_t end = entry.offset + uint64_t(entry.width) * entry.height * 4;
+  if (mappings.empty() || end > mappings.back().file->size()) {
+    if (!remap() || mappings.empty() || end > mappings.back().file->size()) {
+      return false;
+    }
+  }
+
+  Mapping &mapping = mappings.back();
+  mapping.users++;
+  thumbnail.width = static_cast<int>(entry.width);
+  thumbnail.height = static_cast<int>(entry.height);
+  thumbnail.pixels = mapping.file->data() + entry.offset;
+  thumbnail.mapping = mapping.id;
+  return true;
+}
+
+void ThumbnailCache::release(CachedThumbnail &thumbnail) {
+  std::lock_guard<std::mutex> lock(mutex);
+  // Not found once the cache was closed since, nothing left to release then
+  for (size_t i = 0; thumbnail.mapping != 0 && i < mappings.size(); i++) {
+    Mapping &mapping = mappings[i];
+    if (mapping.id != thumbnail.mapping) {
+      continue;
+    }
+    mapping.users--;
+    if (mapping.users == 0 && i + 1 < mappings.size()) {
+      mappings.erase(mappings.begin() + i);
+    }
+    break;
+  }
+  thumbnail.pixels = nullptr;
+  thumbnail.mapping = 0;
+}
+
+void ThumbnailCache::prune(const std::function<bool()> &keep_going) {
+  // Copied so the photos get stat'ed without holding the lock
+  std::unordered_map<std::string, std::vector<uint64_t>> keys_by_path;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto &[key, entry] : entries) {
+      keys_by_path[entry.path.string()].push_back(key);
+    }
+  }
+
+  size_t pruned = 0;
+  for (const auto &[path, keys] : keys_by_path) {
+    if (!keep_going()) {
+      break;
+    }
+    std::error_code error;
+    if (std::filesystem::exists(path, error) || error) {
+      continue;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    for (uint64_t key : keys) {
+      // Gone already, or the cache got reopened for another folder
+      auto it = entries.find(key);
+      if (it == entries.end() || it->second.path.string() != path) {
+        continue;
+      }
+      IndexRecord record{
+          .target_width = it->second.target_width,
+          .path_length = static_cast<uint32_t>(path.size()),
+      };
+      index_stream.write(reinterpret_cast<const char *>(&record),
+                         sizeof(record));
+      index_stream.write(path.data(), path.size());
+      entries.erase(it);
+      pruned++;
+    }
+    index_stream.flush();
+  }
+  if (pruned > 0) {
+    SDL_Log("Thumbnail cache: forgot %zu thumbnails of deleted photos",
+            pruned);
+  }
+}
+
+bool ThumbnailCache::store(const std::filesystem::path &file,
+                           int target_width, const FileStamp &stamp,
+                           const Thumbnail &thumbnail) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!pack_stream.is_open()) {
+    return false;
+  }
+
+  std::string path = file.string();
+  uint64_t bytes = uint64_t(thumbnail.width) * thumbnail.height * 4;
+  IndexRecord record{
+      .file_size = stamp.size,
+      .mtime = stamp.mtime,
+      .offset = pack_size,
+      .target_width = static_cast<uint32_t>(target_width),
+      .width = static_cast<uint32_t>(thumbnail.width),
+      .height = static_cast<uint32_t>(thumbnail.height),
+      .path_length = static_cast<uint32_t>(path.size()),
+  };
+
+  // Pixels go in before the record that points at them
+  pack_stream.write(reinterpret_cast<const char *>(thumbnail.pixels.data()),
+                    bytes);
+  if (!pack_stream) {
+    return false;
+  }
+  pack_stream.flush();
+  index_stream.write(reinterpret_cast<const char *>(&record), sizeof(record));
+  index_stream.write(path.data(), path.size());
+  index_stream.flush();
+
+  entries[entry_key(file, target_width)] = Entry{
+      .path = file,
+      .stamp = stamp,
+      .target_width = record.target_width,
+      .width = record.width,
+      .height = record.height,
+      .offset = record.offset,
+  };
+  pack_size += bytes;
+  return true;
+}